@@ -0,0 +1,99 @@
+// See LICENSE for license details.
+
+#include "bbv.h"
+#include <cinttypes>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+bbv_t::bbv_t(const std::string& path, uint64_t interval)
+  : interval(interval), interval_insns(0), next_pc(-1), block_pc(0),
+    block_insns(0), blocks(1024), nblocks(0)
+{
+  file = fopen(path.c_str(), "w");
+  if (!file) {
+    fprintf(stderr, "Unable to open BBV file '%s': %s\n", path.c_str(),
+            strerror(errno));
+    exit(1);
+  }
+}
+
+bbv_t::~bbv_t()
+{
+  end_block();
+  if (interval_insns)
+    dump_interval();
+  fclose(file);
+}
+
+void bbv_t::start_block(reg_t pc)
+{
+  end_block();
+  block_pc = pc;
+}
+
+void bbv_t::end_block()
+{
+  if (block_insns == 0)
+    return;
+
+  size_t slot = find_slot(block_pc);
+  block_t& b = blocks[slot];
+  if (b.id == 0) {
+    b.pc = block_pc;
+    b.id = ++nblocks;
+  }
+  if (b.count == 0)
+    touched.push_back(slot);
+  b.count += block_insns;
+
+  interval_insns += block_insns;
+  block_insns = 0;
+
+  if (interval_insns >= interval)
+    dump_interval();
+
+  // Keep the load factor below 1/2 so probe sequences stay short.  Growing
+  // here, after the interval has possibly been flushed, keeps touched valid.
+  if (2 * nblocks > blocks.size())
+    grow();
+}
+
+size_t bbv_t::find_slot(reg_t pc)
+{
+  size_t mask = blocks.size() - 1;
+  size_t idx = (size_t)((pc >> 1) * 0x9e3779b97f4a7c15ULL >> 20) & mask;
+  while (blocks[idx].id != 0 && blocks[idx].pc != pc)
+    idx = (idx + 1) & mask;
+  return idx;
+}
+
+void bbv_t::grow()
+{
+  std::vector<block_t> old(blocks.size() * 2);
+  old.swap(blocks);
+
+  touched.clear();
+  for (auto& b : old) {
+    if (b.id == 0)
+      continue;
+    size_t slot = find_slot(b.pc);
+    blocks[slot] = b;
+    if (b.count)
+      touched.push_back(slot);
+  }
+}
+
+void bbv_t::dump_interval()
+{
+  fputc('T', file);
+  for (size_t slot : touched) {
+    block_t& b = blocks[slot];
+    fprintf(file, ":%" PRIu32 ":%" PRIu64 " ", b.id, b.count);
+    b.count = 0;
+  }
+  fputc('\n', file);
+
+  touched.clear();
+  interval_insns = 0;
+}
@@ -0,0 +1,62 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_BBV_H
+#define _RISCV_BBV_H
+
+#include "decode.h"
+#include "common.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Records SimPoint basic-block vectors.  A basic block is identified by the
+// PC at which execution entered it; for every interval of retired
+// instructions we emit, in the SimPoint ".bb" format, how many instructions
+// were executed in each block during that interval.
+class bbv_t
+{
+ public:
+  bbv_t(const std::string& path, uint64_t interval);
+  ~bbv_t();
+
+  // Account one retired instruction of the given length at pc.  Blocks are
+  // delimited lazily: any PC that does not follow on from the previous
+  // instruction (taken branch, jump, trap, interrupt) starts a new block.
+  void step(reg_t pc, int length)
+  {
+    if (unlikely(pc != next_pc))
+      start_block(pc);
+    block_insns++;
+    next_pc = pc + length;
+  }
+
+ private:
+  struct block_t
+  {
+    reg_t pc;
+    uint64_t count; // instructions executed in this block this interval
+    uint32_t id;    // 1-based SimPoint block id, 0 for an empty slot
+  };
+
+  FILE* file;
+  uint64_t interval;
+  uint64_t interval_insns;
+
+  reg_t next_pc;
+  reg_t block_pc;
+  uint64_t block_insns;
+
+  // open-addressing hash table of blocks, keyed by start PC
+  std::vector<block_t> blocks;
+  size_t nblocks;
+  // slots whose count is nonzero in the current interval
+  std::vector<size_t> touched;
+
+  void start_block(reg_t pc);
+  void end_block();
+  size_t find_slot(reg_t pc);
+  void grow();
+  void dump_interval();
+};
+
+#endif
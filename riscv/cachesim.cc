@@ -2,22 +2,33 @@
 
 #include "cachesim.h"
 #include "common.h"
+#include "stats.h"
+#include <algorithm>
 #include <cstdlib>
 #include <iostream>
 #include <iomanip>
+#if defined(__GNUC__) && defined(__x86_64__)
+# include <immintrin.h>
+# define CACHESIM_AVX2
+#endif
 
-cache_sim_t::cache_sim_t(size_t _sets, size_t _ways, size_t _linesz, const char* _name)
+cache_sim_t::cache_sim_t(size_t _sets, size_t _ways, size_t _linesz, const char* _name,
+                         const char* _policy)
  : sets(_sets), ways(_ways), linesz(_linesz), name(_name)
 {
-  init();
+  init(_policy);
 }
 
 static void help()
 {
   std::cerr << "Cache configurations must be of the form" << std::endl;
-  std::cerr << "  sets:ways:blocksize" << std::endl;
+  std::cerr << "  sets:ways:blocksize[:policy][:prefetcher]" << std::endl;
   std::cerr << "where sets, ways, and blocksize are positive integers, with" << std::endl;
   std::cerr << "sets and blocksize both powers of two and blocksize at least 8." << std::endl;
+  std::cerr << "policy is the replacement policy: random (the default), lru" << std::endl;
+  std::cerr << "(up to 256 ways), plru (power-of-two ways, up to 64), or srrip." << std::endl;
+  std::cerr << "A further :prefetcher field attaches a nextline, stride, or stream" << std::endl;
+  std::cerr << "prefetcher; it may also take the place of the policy." << std::endl;
   exit(1);
 }
 
@@ -32,46 +43,130 @@ cache_sim_t* cache_sim_t::construct(const char* config, const char* name)
   size_t ways = atoi(std::string(wp, bp).c_str());
   size_t linesz = atoi(bp);
 
-  if (ways > 4 /* empirical */ && sets == 1)
-    return new fa_cache_sim_t(ways, linesz, name);
-  return new cache_sim_t(sets, ways, linesz, name);
+  // each optional field names either a policy or a prefetcher
+  std::string policy = "random", prefetcher;
+  for (const char* fp = strchr(bp, ':'); fp; ) {
+    const char* end = strchr(++fp, ':');
+    std::string field = end ? std::string(fp, end) : std::string(fp);
+    if (field == "nextline" || field == "stride" || field == "stream")
+      prefetcher = field;
+    else
+      policy = field;
+    fp = end;
+  }
+
+  cache_sim_t* cache;
+  bool lru = policy == "lru";
+  if (ways > 4 /* empirical */ && sets == 1 && (lru || policy == "random"))
+    cache = new fa_cache_sim_t(ways, linesz, name, lru);
+  else
+    cache = new cache_sim_t(sets, ways, linesz, name, policy.c_str());
+  if (!prefetcher.empty())
+    cache->set_prefetcher(prefetcher_t::construct(prefetcher.c_str(), cache->idx_shift));
+  return cache;
+}
+
+static size_t find_way_scalar(const uint64_t* set, size_t ways, uint64_t tag)
+{
+  for (size_t i = 0; i < ways; i++)
+    if (set[i] == tag)
+      return i;
+  return ways;
 }
 
-void cache_sim_t::init()
+#ifdef CACHESIM_AVX2
+__attribute__((target("avx2")))
+static size_t find_way_avx2(const uint64_t* set, size_t ways, uint64_t tag)
+{
+  __m256i t = _mm256_set1_epi64x(tag);
+  size_t i = 0;
+  for (; i + 8 <= ways; i += 8) {
+    __m256i a = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)&set[i]), t);
+    __m256i b = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i*)&set[i+4]), t);
+    int mask = _mm256_movemask_pd(_mm256_castsi256_pd(a)) |
+               _mm256_movemask_pd(_mm256_castsi256_pd(b)) << 4;
+    if (mask)
+      return i + __builtin_ctz(mask);
+  }
+  return i + find_way_scalar(set + i, ways - i, tag);
+}
+#endif
+
+void cache_sim_t::init(const char* policy_name)
 {
   if(sets == 0 || (sets & (sets-1)))
     help();
   if(linesz < 8 || (linesz & (linesz-1)))
     help();
+  if(ways == 0 || !(policy = replacement_policy_t::construct(policy_name, sets, ways)))
+    help();
 
   idx_shift = 0;
   for (size_t x = linesz; x>1; x >>= 1)
     idx_shift++;
 
-  tags = new uint64_t[sets*ways]();
-  read_accesses = 0;
-  read_misses = 0;
-  bytes_read = 0;
-  write_accesses = 0;
-  write_misses = 0;
-  bytes_written = 0;
-  writebacks = 0;
+  tags = new uint64_t[sets*ways];
+  std::fill(tags, tags + sets*ways, uint64_t(INVALID_TAG));
+  dirty = new uint8_t[sets*ways]();
+  reset_stats();
+  use_vector_compare(true);
 
   miss_handler = NULL;
+  bus = NULL;
+  prefetcher = NULL;
+  miss_penalty = 0;
+}
+
+void cache_sim_t::use_vector_compare(bool enable)
+{
+  // Vector compares only pay off once a set spans a few registers.
+  find_way = &find_way_scalar;
+#ifdef CACHESIM_AVX2
+  if (enable && ways >= 8 && __builtin_cpu_supports("avx2"))
+    find_way = &find_way_avx2;
+#endif
 }
 
 cache_sim_t::cache_sim_t(const cache_sim_t& rhs)
- : sets(rhs.sets), ways(rhs.ways), linesz(rhs.linesz),
+ : lfsr(rhs.lfsr), miss_handler(rhs.miss_handler), bus(NULL),
+   prefetcher(rhs.prefetcher ? rhs.prefetcher->clone() : NULL),
+   miss_penalty(rhs.miss_penalty),
+   inflight(rhs.inflight), sets(rhs.sets), ways(rhs.ways), linesz(rhs.linesz),
    idx_shift(rhs.idx_shift), name(rhs.name)
 {
+  reset_stats();
+  policy = rhs.policy->clone();
   tags = new uint64_t[sets*ways];
   memcpy(tags, rhs.tags, sets*ways*sizeof(uint64_t));
+  dirty = new uint8_t[sets*ways];
+  memcpy(dirty, rhs.dirty, sets*ways);
+  find_way = rhs.find_way;
 }
 
 cache_sim_t::~cache_sim_t()
 {
   print_stats();
   delete [] tags;
+  delete [] dirty;
+  delete policy;
+  delete prefetcher;
+}
+
+void cache_sim_t::reset_stats()
+{
+  read_accesses = 0;
+  read_misses = 0;
+  bytes_read = 0;
+  write_accesses = 0;
+  write_misses = 0;
+  bytes_written = 0;
+  writebacks = 0;
+  coherence_misses = 0;
+  invalidations = 0;
+  snoop_writebacks = 0;
+  prefetches_issued = 0;
+  prefetches_useful = 0;
+  prefetches_late = 0;
 }
 
 void cache_sim_t::print_stats()
@@ -98,82 +193,312 @@ void cache_sim_t::print_stats()
   std::cout << "Writebacks:            " << writebacks << std::endl;
   std::cout << name << " ";
   std::cout << "Miss Rate:             " << mr << '%' << std::endl;
+  if (prefetcher) {
+    std::cout << name << " ";
+    std::cout << "Prefetches Issued:     " << prefetches_issued << std::endl;
+    std::cout << name << " ";
+    std::cout << "Prefetches Useful:     " << prefetches_useful << std::endl;
+    std::cout << name << " ";
+    std::cout << "Prefetches Late:       " << prefetches_late << std::endl;
+  }
+  if (!bus)
+    return;
+  std::cout << name << " ";
+  std::cout << "Coherence Misses:      " << coherence_misses << std::endl;
+  std::cout << name << " ";
+  std::cout << "Invalidations:         " << invalidations << std::endl;
+  std::cout << name << " ";
+  std::cout << "Snoop Writebacks:      " << snoop_writebacks << std::endl;
 }
 
-uint64_t* cache_sim_t::check_tag(uint64_t addr)
+void cache_sim_t::dump_stats(stats_writer_t& w)
+{
+  w.add("bytes_read", bytes_read);
+  w.add("bytes_written", bytes_written);
+  w.add("read_accesses", read_accesses);
+  w.add("write_accesses", write_accesses);
+  w.add("read_misses", read_misses);
+  w.add("write_misses", write_misses);
+  w.add("writebacks", writebacks);
+  if (prefetcher) {
+    w.add("prefetches_issued", prefetches_issued);
+    w.add("prefetches_useful", prefetches_useful);
+    w.add("prefetches_late", prefetches_late);
+  }
+  if (bus) {
+    w.add("coherence_misses", coherence_misses);
+    w.add("invalidations", invalidations);
+    w.add("snoop_writebacks", snoop_writebacks);
+  }
+}
+
+uint8_t* cache_sim_t::check_tag(uint64_t addr)
 {
   size_t idx = (addr >> idx_shift) & (sets-1);
-  size_t tag = (addr >> idx_shift) | VALID;
+  size_t way = find_way(&tags[idx*ways], ways, addr >> idx_shift);
+  if (way == ways)
+    return NULL;
 
-  for (size_t i = 0; i < ways; i++)
-    if (tag == (tags[idx*ways + i] & ~DIRTY))
-      return &tags[idx*ways + i];
+  policy->hit(idx, way);
+  return &dirty[idx*ways + way];
+}
 
-  return NULL;
+uint8_t* cache_sim_t::probe(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  size_t way = find_way(&tags[idx*ways], ways, addr >> idx_shift);
+  return way == ways ? NULL : &dirty[idx*ways + way];
+}
+
+void cache_sim_t::invalidate(uint64_t addr)
+{
+  size_t idx = (addr >> idx_shift) & (sets-1);
+  size_t way = find_way(&tags[idx*ways], ways, addr >> idx_shift);
+  if (way != ways) {
+    tags[idx*ways + way] = INVALID_TAG;
+    dirty[idx*ways + way] = 0;
+  }
 }
 
-uint64_t cache_sim_t::victimize(uint64_t addr)
+uint64_t cache_sim_t::victimize(uint64_t addr, bool store)
 {
   size_t idx = (addr >> idx_shift) & (sets-1);
-  size_t way = lfsr.next() % ways;
-  uint64_t victim = tags[idx*ways + way];
-  tags[idx*ways + way] = (addr >> idx_shift) | VALID;
+  // fill an empty way if there is one
+  size_t way = find_way(&tags[idx*ways], ways, INVALID_TAG);
+  if (way == ways)
+    way = policy->victim(idx);
+  size_t i = idx*ways + way;
+  uint64_t victim = tags[i] == INVALID_TAG ? 0 :
+                    tags[i] | VALID | (dirty[i] & LINE_DIRTY ? DIRTY : 0);
+  tags[i] = addr >> idx_shift;
+  dirty[i] = store;
+  policy->fill(idx, way);
   return victim;
 }
 
-void cache_sim_t::access(uint64_t addr, size_t bytes, bool store)
+void cache_sim_t::writeback(uint64_t victim)
+{
+  if ((victim & (VALID | DIRTY)) == (VALID | DIRTY))
+  {
+    uint64_t dirty_addr = (victim & ~(VALID | DIRTY)) << idx_shift;
+    if (miss_handler)
+      miss_handler->access(dirty_addr, linesz, true);
+    writebacks++;
+  }
+}
+
+uint64_t cache_sim_t::access(uint64_t addr, size_t bytes, bool store, uint64_t pc)
 {
   store ? write_accesses++ : read_accesses++;
   (store ? bytes_written : bytes_read) += bytes;
 
-  uint64_t* hit_way = check_tag(addr);
+  if (unlikely(!inflight.empty()))
+    complete_prefetches();
+
+  uint8_t* hit_way = check_tag(addr);
   if (likely(hit_way != NULL))
   {
-    if (store)
-      *hit_way |= DIRTY;
-    return;
+    // a store to a Shared line must first invalidate the other copies
+    if (store && !(*hit_way & LINE_DIRTY) && bus)
+      bus->write(this, addr);
+    *hit_way |= store;
+    if (unlikely(prefetcher != NULL)) {
+      bool first_use = *hit_way & LINE_PREFETCHED;
+      if (first_use) {
+        prefetches_useful++;
+        *hit_way &= ~LINE_PREFETCHED;
+      }
+      prefetch(addr, pc, first_use);
+    }
+    return 0;
   }
 
   store ? write_misses++ : read_misses++;
 
-  uint64_t victim = victimize(addr);
+  if (bus) {
+    if (!invalidated.empty() && invalidated.erase(addr >> idx_shift))
+      coherence_misses++;
+    store ? bus->write(this, addr) : bus->read(this, addr);
+  }
 
-  if ((victim & (VALID | DIRTY)) == (VALID | DIRTY))
-  {
-    uint64_t dirty_addr = (victim & ~(VALID | DIRTY)) << idx_shift;
+  writeback(victimize(addr, store));
+
+  // a late prefetch has already requested the line from the next level
+  bool requested = false;
+  for (auto it = inflight.begin(); it != inflight.end(); ++it) {
+    if (it->line == addr >> idx_shift) {
+      inflight.erase(it);
+      prefetches_late++;
+      requested = true;
+      break;
+    }
+  }
+
+  uint64_t cycles = miss_penalty;
+  if (miss_handler && !requested)
+    cycles += miss_handler->access(addr & ~(linesz-1), linesz, false, pc);
+
+  if (prefetcher)
+    prefetch(addr, pc, true);
+  return cycles;
+}
+
+void cache_sim_t::prefetch(uint64_t addr, uint64_t pc, bool trigger)
+{
+  uint64_t lines[prefetcher_t::MAX_DEGREE];
+  size_t n = prefetcher->access(addr, pc, trigger, lines);
+  uint64_t now = read_accesses + write_accesses;
+
+  for (size_t i = 0; i < n && inflight.size() < MAX_INFLIGHT; i++) {
+    uint64_t line = lines[i];
+    if (probe(line << idx_shift))
+      continue;
+    bool pending = false;
+    for (auto& p : inflight)
+      pending |= p.line == line;
+    if (pending)
+      continue;
+
+    inflight.push_back(prefetch_t{line, now + PREFETCH_LATENCY});
+    prefetches_issued++;
     if (miss_handler)
-      miss_handler->access(dirty_addr, linesz, true);
-    writebacks++;
+      miss_handler->access(line << idx_shift, linesz, false);
   }
+}
 
-  if (miss_handler)
-    miss_handler->access(addr & ~(linesz-1), linesz, false);
+void cache_sim_t::complete_prefetches()
+{
+  uint64_t now = read_accesses + write_accesses;
+  while (!inflight.empty() && inflight.front().ready <= now) {
+    uint64_t addr = inflight.front().line << idx_shift;
+    inflight.pop_front();
+    if (probe(addr))
+      continue;
+    if (bus)
+      bus->read(this, addr);
+    writeback(victimize(addr, false));
+    *probe(addr) |= LINE_PREFETCHED;
+  }
+}
 
-  if (store)
-    *check_tag(addr) |= DIRTY;
+void cache_sim_t::set_coherence_bus(coherence_bus_t* b)
+{
+  bus = b;
+  bus->attach(this);
 }
 
-fa_cache_sim_t::fa_cache_sim_t(size_t ways, size_t linesz, const char* name)
-  : cache_sim_t(1, ways, linesz, name)
+void cache_sim_t::snoop(uint64_t addr, bool inval)
 {
+  uint8_t* line = probe(addr);
+  if (!line)
+    return;
+
+  if (*line & LINE_DIRTY) {
+    if (miss_handler)
+      miss_handler->access(addr & ~(linesz-1), linesz, true);
+    snoop_writebacks++;
+    *line &= ~LINE_DIRTY;
+  }
+  if (inval) {
+    invalidate(addr);
+    invalidations++;
+    invalidated.insert(addr >> idx_shift);
+  }
+}
+
+const uint32_t fa_cache_sim_t::NIL;
+
+fa_cache_sim_t::fa_cache_sim_t(size_t ways, size_t linesz, const char* name, bool lru)
+  : cache_sim_t(1, ways, linesz, name), lru(lru), used(0), head(NIL), tail(NIL),
+    free_nodes(NIL), nodes(ways)
+{
+  size_t nbuckets = 1;
+  while (nbuckets < 2 * ways)
+    nbuckets *= 2;
+  buckets.resize(nbuckets, NIL);
+}
+
+void fa_cache_sim_t::unlink(uint32_t n)
+{
+  node_t& x = nodes[n];
+  (x.prev == NIL ? head : nodes[x.prev].next) = x.next;
+  (x.next == NIL ? tail : nodes[x.next].prev) = x.prev;
+}
+
+void fa_cache_sim_t::push_front(uint32_t n)
+{
+  nodes[n].prev = NIL;
+  nodes[n].next = head;
+  (head == NIL ? tail : nodes[head].prev) = n;
+  head = n;
+}
+
+uint32_t fa_cache_sim_t::find(uint64_t tag)
+{
+  uint32_t n = buckets[bucket(tag)];
+  while (n != NIL && nodes[n].tag != tag)
+    n = nodes[n].chain;
+  return n;
+}
+
+void fa_cache_sim_t::remove(uint32_t n)
+{
+  uint32_t* p = &buckets[bucket(nodes[n].tag)];
+  while (*p != n)
+    p = &nodes[*p].chain;
+  *p = nodes[n].chain;
+  unlink(n);
+}
+
+uint8_t* fa_cache_sim_t::check_tag(uint64_t addr)
+{
+  uint32_t n = find(addr >> idx_shift);
+  if (n == NIL)
+    return NULL;
+  if (lru && n != head) {
+    unlink(n);
+    push_front(n);
+  }
+  return &nodes[n].dirty;
 }
 
-uint64_t* fa_cache_sim_t::check_tag(uint64_t addr)
+uint8_t* fa_cache_sim_t::probe(uint64_t addr)
 {
-  auto it = tags.find(addr >> idx_shift);
-  return it == tags.end() ? NULL : &it->second;
+  uint32_t n = find(addr >> idx_shift);
+  return n == NIL ? NULL : &nodes[n].dirty;
 }
 
-uint64_t fa_cache_sim_t::victimize(uint64_t addr)
+void fa_cache_sim_t::invalidate(uint64_t addr)
+{
+  uint32_t n = find(addr >> idx_shift);
+  if (n == NIL)
+    return;
+  remove(n);
+  nodes[n].tag = INVALID_TAG;
+  nodes[n].chain = free_nodes;
+  free_nodes = n;
+}
+
+uint64_t fa_cache_sim_t::victimize(uint64_t addr, bool store)
 {
   uint64_t old_tag = 0;
-  if (tags.size() == ways)
-  {
-    auto it = tags.begin();
-    std::advance(it, lfsr.next() % ways);
-    old_tag = it->second;
-    tags.erase(it);
+  uint32_t n;
+  if (free_nodes != NIL) {
+    n = free_nodes;
+    free_nodes = nodes[n].chain;
+  } else if (used < ways) {
+    n = used++;
+  } else {
+    n = lru ? tail : lfsr.next() % ways;
+    old_tag = nodes[n].tag | VALID | (nodes[n].dirty & LINE_DIRTY ? DIRTY : 0);
+    remove(n);
   }
-  tags[addr >> idx_shift] = (addr >> idx_shift) | VALID;
+
+  uint32_t& b = buckets[bucket(addr >> idx_shift)];
+  nodes[n].tag = addr >> idx_shift;
+  nodes[n].dirty = store;
+  nodes[n].chain = b;
+  b = n;
+  push_front(n);
   return old_tag;
 }
@@ -4,51 +4,102 @@
 #define _RISCV_CACHE_SIM_H
 
 #include "memtracer.h"
+#include "replacement.h"
+#include "prefetcher.h"
 #include <cstring>
+#include <deque>
 #include <string>
-#include <map>
+#include <vector>
+#include <unordered_set>
 #include <cstdint>
 
-class lfsr_t
-{
- public:
-  lfsr_t() : reg(1) {}
-  lfsr_t(const lfsr_t& lfsr) : reg(lfsr.reg) {}
-  uint32_t next() { return reg = (reg>>1)^(-(reg&1) & 0xd0000001); }
- private:
-  uint32_t reg;
-};
+class coherence_bus_t;
+class stats_writer_t;
 
 class cache_sim_t
 {
  public:
-  cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name);
+  cache_sim_t(size_t sets, size_t ways, size_t linesz, const char* name,
+              const char* policy = "random");
+  // Copies the geometry, contents and miss handler; the copy starts with
+  // fresh statistics and is not on any coherence bus.
   cache_sim_t(const cache_sim_t& rhs);
   virtual ~cache_sim_t();
+  virtual cache_sim_t* clone() const { return new cache_sim_t(*this); }
 
-  void access(uint64_t addr, size_t bytes, bool store);
+  // pc is the address of the instruction making the access, 0 if unknown.
+  // Returns the cycles the access stalls for: the miss penalties of this
+  // and any lower levels it misses in.
+  uint64_t access(uint64_t addr, size_t bytes, bool store, uint64_t pc = 0);
   void print_stats();
+  void dump_stats(stats_writer_t& w);
+  void reset_stats();
   void set_miss_handler(cache_sim_t* mh) { miss_handler = mh; }
+  // Cycles to bring a missing line in from the next level (default 0).
+  void set_miss_penalty(uint64_t cycles) { miss_penalty = cycles; }
+  void set_name(const std::string& n) { name = n; }
+  const std::string& get_name() const { return name; }
+  void set_coherence_bus(coherence_bus_t* bus);
+  // Takes ownership of p.
+  void set_prefetcher(prefetcher_t* p) { delete prefetcher; prefetcher = p; }
+
+  // Called by the coherence bus when another cache reads (invalidate is
+  // false) or writes addr's line: a modified copy is written back, and on
+  // a write this cache's copy is dropped.
+  void snoop(uint64_t addr, bool invalidate);
+  // Compare tags with SIMD instructions when the host supports them (the
+  // default); disabling this is only useful for benchmarking.
+  void use_vector_compare(bool enable);
 
   static cache_sim_t* construct(const char* config, const char* name);
 
  protected:
+  // flags on the tags returned by victimize()
   static const uint64_t VALID = 1ULL << 63;
   static const uint64_t DIRTY = 1ULL << 62;
+  // tag of an empty way; no line address can match it
+  static const uint64_t INVALID_TAG = ~0ULL;
+  // per-line flags, kept in the byte check_tag() returns
+  static const uint8_t LINE_DIRTY = 1;
+  static const uint8_t LINE_PREFETCHED = 2; // not yet used by a demand access
+  // Prefetched lines arrive this many demand accesses after they are
+  // issued; a demand miss on a line still in flight is a late prefetch.
+  static const uint64_t PREFETCH_LATENCY = 4;
+  static const size_t MAX_INFLIGHT = 16;
 
-  virtual uint64_t* check_tag(uint64_t addr);
-  virtual uint64_t victimize(uint64_t addr);
+  // Look up addr's line, returning its flags, or NULL on a miss.
+  virtual uint8_t* check_tag(uint64_t addr);
+  // Like check_tag, but leaves the replacement state alone.
+  virtual uint8_t* probe(uint64_t addr);
+  virtual void invalidate(uint64_t addr);
+  // Install addr's line, dirty if for a store, returning the evicted tag.
+  virtual uint64_t victimize(uint64_t addr, bool store);
 
   lfsr_t lfsr;
+  replacement_policy_t* policy;
   cache_sim_t* miss_handler;
+  coherence_bus_t* bus;
+  prefetcher_t* prefetcher;
+  uint64_t miss_penalty;
+
+  struct prefetch_t
+  {
+    uint64_t line;
+    uint64_t ready; // demand access count at which the line arrives
+  };
+  std::deque<prefetch_t> inflight;
 
   size_t sets;
   size_t ways;
   size_t linesz;
   size_t idx_shift;
 
+  // Line addresses (addr >> idx_shift), ways consecutive per set so a set
+  // can be compared with vector instructions; line flags are kept apart.
   uint64_t* tags;
-  
+  uint8_t* dirty;
+  size_t (*find_way)(const uint64_t* set, size_t ways, uint64_t tag);
+
   uint64_t read_accesses;
   uint64_t read_misses;
   uint64_t bytes_read;
@@ -56,30 +107,99 @@ class cache_sim_t
   uint64_t write_misses;
   uint64_t bytes_written;
   uint64_t writebacks;
+  uint64_t coherence_misses; // misses on lines lost to another cache's write
+  uint64_t invalidations;
+  uint64_t snoop_writebacks;
+  uint64_t prefetches_issued;
+  uint64_t prefetches_useful; // prefetched lines later hit by a demand access
+  uint64_t prefetches_late;   // demand misses on lines still being prefetched
+
+  // lines invalidated by the bus and not yet refetched
+  std::unordered_set<uint64_t> invalidated;
 
   std::string name;
 
-  void init();
+  void init(const char* policy_name);
+  void writeback(uint64_t victim);
+  void prefetch(uint64_t addr, uint64_t pc, bool trigger);
+  void complete_prefetches();
 };
 
+// Fully-associative cache with constant cost per access.  Lines live in a
+// fixed arena of nodes, found through a chained hash table and kept on an
+// intrusive recency list, so nothing is allocated after construction.
 class fa_cache_sim_t : public cache_sim_t
 {
  public:
-  fa_cache_sim_t(size_t ways, size_t linesz, const char* name);
-  uint64_t* check_tag(uint64_t addr);
-  uint64_t victimize(uint64_t addr);
+  fa_cache_sim_t(size_t ways, size_t linesz, const char* name, bool lru);
+  cache_sim_t* clone() const { return new fa_cache_sim_t(*this); }
+ protected:
+  uint8_t* check_tag(uint64_t addr);
+  uint8_t* probe(uint64_t addr);
+  void invalidate(uint64_t addr);
+  uint64_t victimize(uint64_t addr, bool store);
+ private:
+  static const uint32_t NIL = UINT32_MAX;
+
+  struct node_t
+  {
+    uint64_t tag;
+    uint8_t dirty;
+    uint32_t prev, next; // recency list, most recent first
+    uint32_t chain;      // next node in the same hash bucket
+  };
+
+  bool lru;
+  size_t used;
+  uint32_t head, tail;
+  uint32_t free_nodes; // invalidated nodes, linked through chain
+  std::vector<node_t> nodes;
+  std::vector<uint32_t> buckets;
+
+  size_t bucket(uint64_t line)
+  {
+    return (line * 0x9e3779b97f4a7c15ULL) >> 32 & (buckets.size() - 1);
+  }
+  uint32_t find(uint64_t tag);
+  void unlink(uint32_t n);
+  void push_front(uint32_t n);
+  void remove(uint32_t n);
+};
+
+// Keeps a set of private caches coherent with a write-invalidate MSI
+// protocol.  A valid clean line is Shared and a dirty line Modified; the
+// caches snoop each other's misses and upgrades.
+class coherence_bus_t
+{
+ public:
+  void attach(cache_sim_t* cache) { caches.push_back(cache); }
+  void read(cache_sim_t* requester, uint64_t addr)
+  {
+    for (auto c : caches)
+      if (c != requester)
+        c->snoop(addr, false);
+  }
+  void write(cache_sim_t* requester, uint64_t addr)
+  {
+    for (auto c : caches)
+      if (c != requester)
+        c->snoop(addr, true);
+  }
  private:
-  static bool cmp(uint64_t a, uint64_t b);
-  std::map<uint64_t, uint64_t> tags;
+  std::vector<cache_sim_t*> caches;
 };
 
 class cache_memtracer_t : public memtracer_t
 {
  public:
-  cache_memtracer_t(const char* config, const char* name)
+  cache_memtracer_t(const char* config, const char* name) : stalls(NULL)
   {
     cache = cache_sim_t::construct(config, name);
   }
+  cache_memtracer_t(const cache_memtracer_t& rhs) : stalls(NULL)
+  {
+    cache = rhs.cache->clone();
+  }
   ~cache_memtracer_t()
   {
     delete cache;
@@ -88,9 +208,32 @@ class cache_memtracer_t : public memtracer_t
   {
     cache->set_miss_handler(mh);
   }
+  void reset_stats()
+  {
+    cache->reset_stats();
+  }
+  void set_name(const std::string& name)
+  {
+    cache->set_name(name);
+  }
+  void set_coherence_bus(coherence_bus_t* bus)
+  {
+    cache->set_coherence_bus(bus);
+  }
+  cache_sim_t* get_cache() { return cache; }
+  // Add each access's stall cycles to *counter, for a timing model.
+  void set_stall_counter(uint64_t* counter) { stalls = counter; }
 
  protected:
   cache_sim_t* cache;
+  uint64_t* stalls;
+
+  void access(uint64_t addr, size_t bytes, bool store, uint64_t pc)
+  {
+    uint64_t cycles = cache->access(addr, bytes, store, pc);
+    if (stalls)
+      *stalls += cycles;
+  }
 };
 
 class icache_sim_t : public cache_memtracer_t
@@ -103,7 +246,11 @@ class icache_sim_t : public cache_memtracer_t
   }
   void trace(uint64_t addr, size_t bytes, access_type type)
   {
-    if (type == FETCH) cache->access(addr, bytes, false);
+    if (type == FETCH) access(addr, bytes, false, 0);
+  }
+  void trace_pc(uint64_t addr, size_t bytes, access_type type, uint64_t pc)
+  {
+    if (type == FETCH) access(addr, bytes, false, pc);
   }
 };
 
@@ -117,7 +264,11 @@ class dcache_sim_t : public cache_memtracer_t
   }
   void trace(uint64_t addr, size_t bytes, access_type type)
   {
-    if (type == LOAD || type == STORE) cache->access(addr, bytes, type == STORE);
+    if (type == LOAD || type == STORE) access(addr, bytes, type == STORE, 0);
+  }
+  void trace_pc(uint64_t addr, size_t bytes, access_type type, uint64_t pc)
+  {
+    if (type == LOAD || type == STORE) access(addr, bytes, type == STORE, pc);
   }
 };
 
@@ -0,0 +1,115 @@
+// See LICENSE for license details.
+
+#include "callgraph.h"
+#include "symtab.h"
+#include "encoding.h"
+#include <cinttypes>
+#include <cstdio>
+#include <sstream>
+
+callgraph_t::callgraph_t()
+{
+  for (int i = 0; i < 4; i++) {
+    roots[i].func = 0;
+    roots[i].parent = NULL;
+    roots[i].depth = 0;
+    roots[i].self = 0;
+    current[i] = &roots[i];
+    dropped[i] = 0;
+  }
+}
+
+callgraph_t::~callgraph_t()
+{
+  for (int i = 0; i < 4; i++)
+    free_children(&roots[i]);
+}
+
+void callgraph_t::free_children(node_t* n)
+{
+  for (auto& c : n->children) {
+    free_children(c.second);
+    delete c.second;
+  }
+}
+
+void callgraph_t::control_transfer(reg_t npc, insn_t insn, reg_t prv, unsigned xlen)
+{
+  insn_bits_t bits = insn.bits();
+  bool call, ret;
+
+  if (insn.length() == 2) {
+    bool jr = (bits & MASK_C_JR) == MATCH_C_JR && insn.rvc_rs1() != 0;
+    call = ((bits & MASK_C_JALR) == MATCH_C_JALR && insn.rvc_rs1() != 0) ||
+           (xlen == 32 && (bits & MASK_C_JAL) == MATCH_C_JAL);
+    ret = jr && insn.rvc_rs1() == X_RA;
+  } else {
+    bool jal = (bits & MASK_JAL) == MATCH_JAL;
+    bool jalr = (bits & MASK_JALR) == MATCH_JALR;
+    call = (jal || jalr) && insn.rd() == X_RA;
+    ret = jalr && insn.rd() == 0 && insn.rs1() == X_RA;
+  }
+
+  node_t*& cur = current[prv];
+  if (call) {
+    // deeper calls are charged to the deepest frame, and so are their
+    // returns, so the frames above it stay matched
+    if (cur->depth == MAX_DEPTH) {
+      dropped[prv]++;
+      return;
+    }
+    node_t*& child = cur->children[npc];
+    if (!child)
+      child = new node_t{npc, cur, cur->depth + 1, 0, {}};
+    cur = child;
+  } else if (ret && dropped[prv]) {
+    dropped[prv]--;
+  } else if (ret && cur->parent) {
+    cur = cur->parent;
+  }
+}
+
+void callgraph_t::write_node(FILE* out, const node_t* n, std::string& stack,
+                             const symtab_t& symtab) const
+{
+  size_t len = stack.size();
+  if (n->parent) {
+    const symtab_t::symbol_t* sym = symtab.lookup(n->func);
+    if (sym) {
+      stack += ";" + sym->name;
+    } else {
+      std::ostringstream s;
+      s << ";0x" << std::hex << n->func;
+      stack += s.str();
+    }
+  }
+
+  if (n->self)
+    fprintf(out, "%s %" PRIu64 "\n", stack.c_str(), n->self);
+  for (auto& c : n->children)
+    write_node(out, c.second, stack, symtab);
+
+  stack.resize(len);
+}
+
+void callgraph_t::write_folded(const std::string& prefix, uint32_t hartid,
+                               const symtab_t& symtab) const
+{
+  static const char* prv_names[] = {"U", "S", "H", "M"};
+
+  for (int i = 0; i < 4; i++) {
+    if (!roots[i].self && roots[i].children.empty())
+      continue;
+
+    std::string path = prefix + "." + std::to_string(hartid) + "." +
+                       prv_names[i] + ".folded";
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+      fprintf(stderr, "Unable to write call graph to %s\n", path.c_str());
+      continue;
+    }
+    std::string stack = std::string(prv_names[i]) + "-mode";
+    write_node(out, &roots[i], stack, symtab);
+    fclose(out);
+  }
+}
@@ -0,0 +1,60 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_CALLGRAPH_H
+#define _RISCV_CALLGRAPH_H
+
+#include "decode.h"
+#include "common.h"
+#include <string>
+#include <unordered_map>
+
+class symtab_t;
+
+// Tracks the guest call stack of one hart by watching calls (jal/jalr that
+// link to ra) and returns (jalr x0, 0(ra)), and charges every retired
+// instruction to the current stack.  Each privilege level keeps its own
+// stack, so traps and xRETs switch between them without unwinding.  The
+// result is written as collapsed stacks for flamegraph.pl.
+class callgraph_t
+{
+ public:
+  callgraph_t();
+  ~callgraph_t();
+
+  void step(reg_t pc, reg_t npc, insn_t insn, reg_t prv, unsigned xlen)
+  {
+    current[prv]->self++;
+    if (unlikely(npc != pc + insn.length()))
+      control_transfer(npc, insn, prv, xlen);
+  }
+
+  // Write <prefix>.<hartid>.<prv>.folded for each privilege level that
+  // executed any instructions.
+  void write_folded(const std::string& prefix, uint32_t hartid,
+                    const symtab_t& symtab) const;
+
+ private:
+  struct node_t
+  {
+    reg_t func;       // entry PC of the called function
+    node_t* parent;
+    unsigned depth;
+    uint64_t self;    // instructions retired in this frame
+    std::unordered_map<reg_t, node_t*> children;
+  };
+
+  // bound the stack so unmatched calls (longjmp, context switches) can't
+  // grow it without limit
+  static const unsigned MAX_DEPTH = 512;
+
+  node_t roots[4];
+  node_t* current[4];
+  uint64_t dropped[4];  // calls past MAX_DEPTH whose returns are still due
+
+  void control_transfer(reg_t npc, insn_t insn, reg_t prv, unsigned xlen);
+  static void free_children(node_t* n);
+  void write_node(FILE* out, const node_t* n, std::string& stack,
+                  const symtab_t& symtab) const;
+};
+
+#endif
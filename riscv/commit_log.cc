@@ -0,0 +1,119 @@
+// See LICENSE for license details.
+
+#include "commit_log.h"
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+
+commit_log_writer_t::commit_log_writer_t(const char* path)
+  : done(false)
+{
+  file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "Unable to open commit log '%s': %s\n", path,
+            strerror(errno));
+    exit(1);
+  }
+  fwrite(COMMIT_LOG_MAGIC, 1, COMMIT_LOG_MAGIC_SIZE, file);
+  thread = std::thread(&commit_log_writer_t::run, this);
+}
+
+commit_log_writer_t::~commit_log_writer_t()
+{
+  {
+    std::lock_guard<std::mutex> guard(lock);
+    done = true;
+  }
+  pending_cond.notify_one();
+  thread.join();
+  fclose(file);
+
+  for (auto buf : free_buffers)
+    delete buf;
+}
+
+commit_log_writer_t::buffer_t* commit_log_writer_t::get_buffer()
+{
+  std::lock_guard<std::mutex> guard(lock);
+  if (free_buffers.empty()) {
+    buffer_t* buf = new buffer_t;
+    buf->data.resize(BUFFER_SIZE);
+    return buf;
+  }
+  buffer_t* buf = free_buffers.back();
+  free_buffers.pop_back();
+  return buf;
+}
+
+void commit_log_writer_t::submit(buffer_t* buf)
+{
+  std::unique_lock<std::mutex> guard(lock);
+  space_cond.wait(guard, [&]{ return pending.size() < MAX_PENDING; });
+  pending.push_back(buf);
+  guard.unlock();
+  pending_cond.notify_one();
+}
+
+void commit_log_writer_t::release(buffer_t* buf)
+{
+  std::lock_guard<std::mutex> guard(lock);
+  free_buffers.push_back(buf);
+}
+
+void commit_log_writer_t::run()
+{
+  std::unique_lock<std::mutex> guard(lock);
+  while (true) {
+    pending_cond.wait(guard, [&]{ return done || !pending.empty(); });
+    if (pending.empty())
+      break;
+
+    buffer_t* buf = pending.front();
+    pending.pop_front();
+    guard.unlock();
+    space_cond.notify_one();
+
+    uint8_t header[8];
+    for (int i = 0; i < 4; i++) {
+      header[i] = uint8_t(buf->hartid >> (8 * i));
+      header[4 + i] = uint8_t(buf->size >> (8 * i));
+    }
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(&buf->data[0], 1, buf->size, file) != buf->size) {
+      fprintf(stderr, "Error writing commit log: %s\n", strerror(errno));
+      exit(1);
+    }
+
+    guard.lock();
+    free_buffers.push_back(buf);
+  }
+}
+
+commit_log_stream_t::commit_log_stream_t(commit_log_writer_t* writer, uint32_t hartid)
+  : writer(writer), hartid(hartid), next_pc(0)
+{
+  reset_buffer();
+}
+
+commit_log_stream_t::~commit_log_stream_t()
+{
+  flush();
+  writer->release(buf);
+}
+
+void commit_log_stream_t::reset_buffer()
+{
+  buf = writer->get_buffer();
+  buf->hartid = hartid;
+  pos = &buf->data[0];
+  end = pos + buf->data.size();
+}
+
+void commit_log_stream_t::flush()
+{
+  buf->size = pos - &buf->data[0];
+  if (buf->size == 0)
+    return;
+  writer->submit(buf);
+  reset_buffer();
+}
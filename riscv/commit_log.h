@@ -0,0 +1,138 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_COMMIT_LOG_H
+#define _RISCV_COMMIT_LOG_H
+
+#include "decode.h"
+#include "common.h"
+#include <condition_variable>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Binary commit log format, expanded back to the text commit log by
+// spike-log-decode.
+//
+// The file starts with COMMIT_LOG_MAGIC, followed by chunks, each holding
+// the records of one hart:
+//   uint32 hartid, uint32 length (little-endian), then length bytes of records
+// Each record is
+//   flags     1 byte: [1:0] priv, [2] register written,
+//                     [4:3] log2(xlen) - 5, [6:5] log2(flen) - 4 (0 if no FP)
+//   pc        zigzag LEB128 of pc minus the fall-through PC of the hart's
+//             previous record (so sequential code costs one byte)
+//   insn      insn_length() bytes, little-endian
+//   rd        1 byte, only if written: reg << 1 | is_fp
+//   value     xlen/8 or flen/8 bytes, only if written, little-endian
+#define COMMIT_LOG_MAGIC "SPKCLOG1"
+#define COMMIT_LOG_MAGIC_SIZE 8
+
+#define COMMIT_LOG_PRIV_MASK  0x03
+#define COMMIT_LOG_WRITE      0x04
+#define COMMIT_LOG_XLEN_SHIFT 3
+#define COMMIT_LOG_FLEN_SHIFT 5
+
+// Owns the log file and a background thread that writes filled hart
+// buffers to it, so the simulation thread only ever copies bytes.
+class commit_log_writer_t
+{
+ public:
+  struct buffer_t
+  {
+    uint32_t hartid;
+    size_t size;
+    std::vector<uint8_t> data;
+  };
+
+  static const size_t BUFFER_SIZE = 1 << 20;
+
+  commit_log_writer_t(const char* path);
+  // Writes out everything submitted so far before returning.
+  ~commit_log_writer_t();
+
+  buffer_t* get_buffer();
+  void submit(buffer_t* buf);
+  // return an unused buffer
+  void release(buffer_t* buf);
+
+ private:
+  // submitters block once this many buffers are waiting to be written
+  static const size_t MAX_PENDING = 16;
+
+  FILE* file;
+  std::mutex lock;
+  std::condition_variable pending_cond;
+  std::condition_variable space_cond;
+  std::deque<buffer_t*> pending;
+  std::vector<buffer_t*> free_buffers;
+  bool done;
+  std::thread thread;
+
+  void run();
+};
+
+// Per-hart encoder.  Records are appended to a private buffer that is
+// handed to the writer when full.
+class commit_log_stream_t
+{
+ public:
+  commit_log_stream_t(commit_log_writer_t* writer, uint32_t hartid);
+  ~commit_log_stream_t();
+
+  void record(reg_t priv, int xlen, int flen, reg_t pc, insn_t insn,
+              reg_t rd, freg_t value)
+  {
+    // worst case: flags, 10-byte PC, 8-byte insn, rd, 16-byte value
+    if (unlikely(pos + 36 > end))
+      flush();
+
+    int len = insn.length();
+    uint8_t flags = (priv & COMMIT_LOG_PRIV_MASK) |
+                    (rd ? COMMIT_LOG_WRITE : 0) |
+                    (width_log2(xlen) - 5) << COMMIT_LOG_XLEN_SHIFT |
+                    (flen ? width_log2(flen) - 4 : 0) << COMMIT_LOG_FLEN_SHIFT;
+    *pos++ = flags;
+
+    int64_t delta = pc - next_pc;
+    uint64_t zz = (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+    while (zz >= 0x80) {
+      *pos++ = uint8_t(zz) | 0x80;
+      zz >>= 7;
+    }
+    *pos++ = uint8_t(zz);
+    next_pc = pc + len;
+
+    put(insn.bits(), len);
+
+    if (rd) {
+      *pos++ = uint8_t(rd);
+      int size = (rd & 1 ? flen : xlen) / 8;
+      put(value.v[0], size < 8 ? size : 8);
+      if (size > 8)
+        put(value.v[1], size - 8);
+    }
+  }
+
+  void flush();
+
+ private:
+  commit_log_writer_t* writer;
+  uint32_t hartid;
+  commit_log_writer_t::buffer_t* buf;
+  uint8_t* pos;
+  uint8_t* end;
+  reg_t next_pc;
+
+  void put(uint64_t x, int bytes)
+  {
+    for (int i = 0; i < bytes; i++)
+      *pos++ = uint8_t(x >> (8 * i));
+  }
+
+  static int width_log2(int x) { return x == 32 ? 5 : x == 64 ? 6 : 7; }
+  void reset_buffer();
+};
+
+#endif
@@ -0,0 +1,30 @@
+// See LICENSE for license details.
+
+#include "config_list.h"
+#include <cstdlib>
+
+void parse_config_list(const char* spec,
+                       std::function<bool(const std::string&, uint64_t)> set,
+                       void (*help)())
+{
+  std::string s(spec);
+  size_t start = 0;
+  while (start < s.size()) {
+    size_t end = s.find(',', start);
+    if (end == std::string::npos)
+      end = s.size();
+    std::string item = s.substr(start, end - start);
+    size_t eq = item.find('=');
+    if (eq == std::string::npos)
+      help();
+
+    char* p;
+    uint64_t value = strtoull(item.c_str() + eq + 1, &p, 0);
+    if (eq + 1 == item.size() || *p)
+      help();
+
+    if (!set(item.substr(0, eq), value))
+      help();
+    start = end + 1;
+  }
+}
@@ -0,0 +1,18 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_CONFIG_LIST_H
+#define _RISCV_CONFIG_LIST_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+
+// Parses spec, a comma-separated list of name=value with each value an
+// unsigned integer (decimal, hex or octal), calling set(name, value) for
+// each item in order.  set returns false for a name it doesn't know.
+// Calls help(), which must not return, if an item is malformed or unknown.
+void parse_config_list(const char* spec,
+                       std::function<bool(const std::string&, uint64_t)> set,
+                       void (*help)());
+
+#endif
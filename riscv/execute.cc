@@ -2,6 +2,10 @@
 
 #include "processor.h"
 #include "mmu.h"
+#include "bbv.h"
+#include "callgraph.h"
+#include "commit_log.h"
+#include "timing.h"
 #include <cassert>
 
 
@@ -35,14 +39,21 @@ static void commit_log_print_value(int width, uint64_t hi, uint64_t lo)
   }
 }
 
-static void commit_log_print_insn(state_t* state, reg_t pc, insn_t insn)
+static void commit_log_print_insn(processor_t* p, reg_t pc, insn_t insn)
 {
 #ifdef RISCV_ENABLE_COMMITLOG
+  state_t* state = p->get_state();
   auto& reg = state->log_reg_write;
   int priv = state->last_inst_priv;
   int xlen = state->last_inst_xlen;
   int flen = state->last_inst_flen;
 
+  if (commit_log_stream_t* log = p->get_commit_log()) {
+    log->record(priv, xlen, flen, pc, insn, reg.addr, reg.data);
+    reg.addr = 0;
+    return;
+  }
+
   fprintf(stderr, "%1d ", priv);
   commit_log_print_value(xlen, 0, pc);
   fprintf(stderr, " (");
@@ -62,13 +73,24 @@ static void commit_log_print_insn(state_t* state, reg_t pc, insn_t insn)
 #endif
 }
 
-inline void processor_t::update_histogram(reg_t pc)
+inline void processor_t::update_histogram(reg_t pc, reg_t npc, insn_t insn)
 {
 #ifdef RISCV_ENABLE_HISTOGRAM
-  pc_histogram[pc]++;
+  if (histogram_enabled)
+    pc_histogram.record(pc);
+  if (unlikely(bbv != NULL))
+    bbv->step(pc, insn.length());
+  if (unlikely(callgraph != NULL))
+    callgraph->step(pc, npc, insn, state.prv, xlen);
 #endif
 }
 
+inline void processor_t::update_timing(reg_t pc, reg_t npc, insn_t insn)
+{
+  if (unlikely(timing != NULL))
+    timing->step(pc, npc, insn);
+}
+
 // This is expected to be inlined by the compiler so each use of execute_insn
 // includes a duplicated body of the function to get separate fetch.func
 // function calls.
@@ -77,15 +99,17 @@ static reg_t execute_insn(processor_t* p, reg_t pc, insn_fetch_t fetch)
   commit_log_stash_privilege(p);
   reg_t npc = fetch.func(p, fetch.insn, pc);
   if (!invalid_pc(npc)) {
-    commit_log_print_insn(p->get_state(), pc, fetch.insn);
-    p->update_histogram(pc);
+    commit_log_print_insn(p, pc, fetch.insn);
+    p->update_histogram(pc, npc, fetch.insn);
+    p->update_timing(pc, npc, fetch.insn);
   }
   return npc;
 }
 
 bool processor_t::slow_path()
 {
-  return debug || state.single_step != state.STEP_NONE || state.dcsr.cause;
+  return debug || state.single_step != state.STEP_NONE || state.dcsr.cause ||
+         instret_synced;
 }
 
 // fetch/decode/execute loop
@@ -100,6 +124,7 @@ void processor_t::step(size_t n)
     }
   }
 
+  instret_synced = false;
   while (n > 0) {
     size_t instret = 0;
     reg_t pc = state.pc;
@@ -148,9 +173,15 @@ void processor_t::step(size_t n)
           if (unlikely(state.pc >= DEBUG_ROM_ENTRY &&
                        state.pc < DEBUG_END)) {
             // We're waiting for the debugger to tell us something.
+            instret_synced = true;
             return;
           }
 
+          // The instruction sync_instret() asked to run again has retired.
+          if (unlikely(instret_synced)) {
+            instret_synced = false;
+            break;
+          }
         }
       }
       else while (instret < n)
@@ -213,6 +244,13 @@ void processor_t::step(size_t n)
         enter_debug_mode(DCSR_CAUSE_STEP);
       }
     }
+    catch (instret_sync_t&)
+    {
+      // The instruction at pc made no access yet.  Once the instructions
+      // before it are in minstret, run it again on the slow path, where it
+      // is the first and only one of its pass.
+      instret_synced = true;
+    }
     catch (trigger_matched_t& t)
     {
       if (mmu->matched_trigger) {
@@ -245,4 +283,5 @@ void processor_t::step(size_t n)
     state.minstret += instret;
     n -= instret;
   }
+  instret_synced = true;
 }
@@ -0,0 +1,112 @@
+// See LICENSE for license details.
+
+#include "file_store.h"
+#include "stats.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// File layout: a header page, the presence bitmap, then the pages.
+static const char MAGIC[8] = {'S', 'P', 'K', 'R', 'M', 'E', 'M', '1'};
+static const size_t BITMAP_OFFSET = remote_store_t::PAGE_SIZE;
+static const size_t PAGES_OFFSET = BITMAP_OFFSET + file_store_t::MAX_PAGES / 8;
+static const size_t FILE_SIZE =
+    PAGES_OFFSET + file_store_t::MAX_PAGES * remote_store_t::PAGE_SIZE;
+
+file_store_t::file_store_t(const char* path)
+  : path(path), count(0)
+{
+  fd = open(path, O_RDWR | O_CREAT, 0644);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "remote memory: can't open %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  bool fresh = st.st_size == 0;
+  if (!fresh && size_t(st.st_size) != FILE_SIZE) {
+    fprintf(stderr, "remote memory: %s is not a remote memory file\n", path);
+    exit(1);
+  }
+  if (fresh && ftruncate(fd, FILE_SIZE) < 0) {
+    fprintf(stderr, "remote memory: can't size %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+
+  void* p = mmap(NULL, FILE_SIZE, PROT_READ | PROT_WRITE,
+                 MAP_SHARED | MAP_NORESERVE, fd, 0);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "remote memory: can't map %s: %s\n", path, strerror(errno));
+    exit(1);
+  }
+  base = (uint8_t*)p;
+  bitmap = (uint64_t*)(base + BITMAP_OFFSET);
+  pages = base + PAGES_OFFSET;
+
+  if (fresh) {
+    memcpy(base, MAGIC, sizeof MAGIC);
+  } else if (memcmp(base, MAGIC, sizeof MAGIC) != 0) {
+    fprintf(stderr, "remote memory: %s is not a remote memory file\n", path);
+    exit(1);
+  } else {
+    for (size_t i = 0; i < MAX_PAGES / 64; i++)
+      count += __builtin_popcountll(bitmap[i]);
+  }
+}
+
+file_store_t::~file_store_t()
+{
+  munmap(base, FILE_SIZE);
+  close(fd);
+}
+
+bool file_store_t::write(uint64_t key, const uint8_t* page)
+{
+  if (key >= MAX_PAGES)
+    return false;
+  memcpy(pages + key * PAGE_SIZE, page, PAGE_SIZE);
+  if (!contains(key)) {
+    bitmap[key / 64] |= uint64_t(1) << (key % 64);
+    count++;
+  }
+  return true;
+}
+
+bool file_store_t::read(uint64_t key, uint8_t* page)
+{
+  if (!contains(key))
+    return false;
+  memcpy(page, pages + key * PAGE_SIZE, PAGE_SIZE);
+  return true;
+}
+
+bool file_store_t::contains(uint64_t key)
+{
+  return key < MAX_PAGES && (bitmap[key / 64] >> (key % 64)) & 1;
+}
+
+bool file_store_t::erase(uint64_t key)
+{
+  if (!contains(key))
+    return false;
+  bitmap[key / 64] &= ~(uint64_t(1) << (key % 64));
+  count--;
+  // give the page's disk space back; if the file system can't, the data
+  // just stays behind unreachable
+  fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+            PAGES_OFFSET + key * PAGE_SIZE, PAGE_SIZE);
+  return true;
+}
+
+void file_store_t::dump_stats(stats_writer_t& w)
+{
+  struct stat st;
+  fstat(fd, &st);
+  w.add("pages", uint64_t(count));
+  w.add("file_bytes", uint64_t(st.st_blocks) * 512);
+}
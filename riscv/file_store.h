@@ -0,0 +1,46 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_FILE_STORE_H
+#define _RISCV_FILE_STORE_H
+
+#include "remote_store.h"
+#include <string>
+
+// A store of remote pages in a sparse file, mapped into the simulator's
+// address space.  Page n lives at a fixed offset in the file, so pages only
+// take host memory while the kernel caches them, and the file only takes
+// disk space for pages that were written.  A bitmap at the start of the
+// file records which pages are present, so the contents survive from one
+// run to the next and the file can be shared by every model that uses it.
+class file_store_t : public remote_store_t
+{
+ public:
+  // Page numbers must be below this (the size of a PFA remote ppn)
+  static const uint64_t MAX_PAGES = uint64_t(1) << 28;
+
+  // Open path, creating it if it doesn't exist.  Exits on failure.
+  file_store_t(const char* path);
+  ~file_store_t();
+
+  bool write(uint64_t key, const uint8_t* page);
+  bool read(uint64_t key, uint8_t* page);
+  bool contains(uint64_t key);
+  bool erase(uint64_t key);
+
+  uint64_t key_limit() const { return MAX_PAGES; }
+  size_t size() const { return count; }
+  void dump_stats(stats_writer_t& w);
+
+ private:
+  std::string path;
+  int fd;
+  uint8_t* base;    // the whole file
+  uint64_t* bitmap; // one bit per page, set if it is present
+  uint8_t* pages;
+  size_t count;
+
+  file_store_t(const file_store_t&) = delete;
+  file_store_t& operator=(const file_store_t&) = delete;
+};
+
+#endif
@@ -0,0 +1,79 @@
+// See LICENSE for license details.
+
+#include "histogram.h"
+#include "symtab.h"
+#include <algorithm>
+#include <cinttypes>
+#include <map>
+#include <vector>
+
+pc_histogram_t::~pc_histogram_t()
+{
+  for (auto& p : pages)
+    delete [] p.second;
+}
+
+void pc_histogram_t::switch_page(reg_t page)
+{
+  uint64_t*& counts = pages[page];
+  if (!counts)
+    counts = new uint64_t[PAGE_SLOTS]();
+  last_page = page;
+  last_counts = counts;
+}
+
+void pc_histogram_t::write_profile(FILE* out, const symtab_t& symtab) const
+{
+  std::map<const symtab_t::symbol_t*, uint64_t> funcs;
+  uint64_t total = 0;
+  for (auto& p : pages) {
+    reg_t base = p.first << PAGE_SHIFT;
+    const symtab_t::symbol_t* sym = NULL;
+    reg_t sym_end = 0;
+    for (size_t i = 0; i < PAGE_SLOTS; i++) {
+      if (!p.second[i])
+        continue;
+      reg_t pc = base + 2 * i;
+      // consecutive PCs usually belong to the same function
+      if (!sym || pc < sym->addr || pc >= sym_end) {
+        sym = symtab.lookup(pc);
+        sym_end = sym && sym->size ? sym->addr + sym->size : pc + 2;
+      }
+      funcs[sym] += p.second[i];
+      total += p.second[i];
+    }
+  }
+
+  std::vector<std::pair<uint64_t, const symtab_t::symbol_t*>> sorted;
+  for (auto& f : funcs)
+    sorted.push_back(std::make_pair(f.second, f.first));
+  std::sort(sorted.begin(), sorted.end(),
+            [](const std::pair<uint64_t, const symtab_t::symbol_t*>& a,
+               const std::pair<uint64_t, const symtab_t::symbol_t*>& b) {
+              return a.first > b.first;
+            });
+
+  fprintf(out, "# %" PRIu64 " instructions in %zu functions\n", total, sorted.size());
+  for (auto& f : sorted)
+    fprintf(out, "%16" PRIu64 " %6.2f%%  %s\n", f.first,
+            100.0 * f.first / total, f.second ? f.second->name.c_str() : "[unknown]");
+}
+
+void pc_histogram_t::write_pcs(FILE* out, const symtab_t& symtab) const
+{
+  std::vector<reg_t> sorted;
+  for (auto& p : pages)
+    sorted.push_back(p.first);
+  std::sort(sorted.begin(), sorted.end());
+
+  for (reg_t page : sorted) {
+    const uint64_t* counts = pages.find(page)->second;
+    for (size_t i = 0; i < PAGE_SLOTS; i++) {
+      if (!counts[i])
+        continue;
+      reg_t pc = (page << PAGE_SHIFT) + 2 * i;
+      fprintf(out, "%016" PRIx64 " %" PRIu64 " %s\n", pc, counts[i],
+              symtab.describe(pc).c_str());
+    }
+  }
+}
@@ -0,0 +1,47 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_HISTOGRAM_H
+#define _RISCV_HISTOGRAM_H
+
+#include "decode.h"
+#include "common.h"
+#include <cstdio>
+#include <unordered_map>
+
+class symtab_t;
+
+// Per-PC execution counts.  Counters live in flat per-page arrays, so the
+// per-instruction update is an array increment; the page lookup is only
+// repeated when execution moves to a different page.
+class pc_histogram_t
+{
+ public:
+  pc_histogram_t() : last_page(-1), last_counts(NULL) {}
+  ~pc_histogram_t();
+
+  void record(reg_t pc)
+  {
+    reg_t page = pc >> PAGE_SHIFT;
+    if (unlikely(page != last_page))
+      switch_page(page);
+    last_counts[(pc >> 1) & (PAGE_SLOTS - 1)]++;
+  }
+
+  // Instruction counts summed per function, most frequent first.
+  void write_profile(FILE* out, const symtab_t& symtab) const;
+  // Every executed PC with its count and symbol, in address order.
+  void write_pcs(FILE* out, const symtab_t& symtab) const;
+
+ private:
+  static const int PAGE_SHIFT = 12;
+  // instructions are at least 2-byte aligned
+  static const size_t PAGE_SLOTS = (size_t(1) << PAGE_SHIFT) / 2;
+
+  std::unordered_map<reg_t, uint64_t*> pages;
+  reg_t last_page;
+  uint64_t* last_counts;
+
+  void switch_page(reg_t page);
+};
+
+#endif
@@ -0,0 +1,148 @@
+// See LICENSE for license details.
+
+#include "lz.h"
+#include <cstring>
+
+static const size_t MIN_MATCH = 4;
+static const size_t MAX_OFFSET = 65535;
+static const int HASH_BITS = 12;
+
+static uint32_t read32(const uint8_t* p)
+{
+  uint32_t v;
+  memcpy(&v, p, sizeof v);
+  return v;
+}
+
+static size_t hash(uint32_t v)
+{
+  return (v * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// Append a length's continuation bytes (for a nibble that saturated at 15).
+static uint8_t* put_length(uint8_t* op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = len;
+  return op;
+}
+
+// Emit one sequence: literals [lit, lit + lit_len), then a match of
+// match_len bytes at offset back (match_len 0 for the final sequence).
+// Returns NULL if it would not fit before end.
+static uint8_t* put_sequence(uint8_t* op, uint8_t* end, const uint8_t* lit,
+                             size_t lit_len, size_t offset, size_t match_len)
+{
+  size_t ml = match_len ? match_len - MIN_MATCH : 0;
+  size_t need = 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1;
+  if (need > size_t(end - op))
+    return NULL;
+
+  uint8_t* token = op++;
+  *token = (lit_len < 15 ? lit_len : 15) << 4;
+  if (lit_len >= 15)
+    op = put_length(op, lit_len - 15);
+  memcpy(op, lit, lit_len);
+  op += lit_len;
+
+  if (match_len) {
+    *op++ = offset;
+    *op++ = offset >> 8;
+    *token |= ml < 15 ? ml : 15;
+    if (ml >= 15)
+      op = put_length(op, ml - 15);
+  }
+  return op;
+}
+
+size_t lz_compress(const uint8_t* in, size_t n, uint8_t* out, size_t cap)
+{
+  uint32_t table[1 << HASH_BITS]; // position + 1 of the last sequence seen
+  memset(table, 0, sizeof table);
+
+  const uint8_t* ip = in;
+  const uint8_t* anchor = in;
+  const uint8_t* end = in + n;
+  uint8_t* op = out;
+  uint8_t* oend = out + cap;
+
+  while (end - ip >= (ptrdiff_t)MIN_MATCH) {
+    uint32_t v = read32(ip);
+    size_t h = hash(v);
+    const uint8_t* ref = table[h] ? in + table[h] - 1 : NULL;
+    table[h] = ip - in + 1;
+
+    if (!ref || size_t(ip - ref) > MAX_OFFSET || read32(ref) != v) {
+      ip++;
+      continue;
+    }
+
+    size_t len = MIN_MATCH;
+    while (ip + len < end && ref[len] == ip[len])
+      len++;
+    op = put_sequence(op, oend, anchor, ip - anchor, ip - ref, len);
+    if (!op)
+      return 0;
+    ip += len;
+    anchor = ip;
+  }
+
+  op = put_sequence(op, oend, anchor, end - anchor, 0, 0);
+  return op ? op - out : 0;
+}
+
+// Read a length's continuation bytes.  Returns false on running out of input.
+static bool get_length(const uint8_t*& ip, const uint8_t* end, size_t& len)
+{
+  uint8_t b;
+  do {
+    if (ip == end)
+      return false;
+    b = *ip++;
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+bool lz_decompress(const uint8_t* in, size_t n, uint8_t* out, size_t out_n)
+{
+  const uint8_t* ip = in;
+  const uint8_t* end = in + n;
+  uint8_t* op = out;
+  uint8_t* oend = out + out_n;
+
+  while (ip < end) {
+    uint8_t token = *ip++;
+
+    size_t lit_len = token >> 4;
+    if (lit_len == 15 && !get_length(ip, end, lit_len))
+      return false;
+    if (lit_len > size_t(end - ip) || lit_len > size_t(oend - op))
+      return false;
+    memcpy(op, ip, lit_len);
+    ip += lit_len;
+    op += lit_len;
+
+    if (ip == end)
+      break;
+
+    if (end - ip < 2)
+      return false;
+    size_t offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    size_t match_len = (token & 15) + MIN_MATCH;
+    if ((token & 15) == 15 && !get_length(ip, end, match_len))
+      return false;
+    if (offset == 0 || offset > size_t(op - out) || match_len > size_t(oend - op))
+      return false;
+
+    // byte by byte, since the match may overlap what it produces
+    const uint8_t* ref = op - offset;
+    for (size_t i = 0; i < match_len; i++)
+      op[i] = ref[i];
+    op += match_len;
+  }
+
+  return op == oend;
+}
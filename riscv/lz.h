@@ -0,0 +1,23 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_LZ_H
+#define _RISCV_LZ_H
+
+#include <cstddef>
+#include <cstdint>
+
+// A small LZ77 codec in the style of LZ4, for buffers of up to 64 KiB.
+// The output is a run of sequences, each a token byte (literal count in the
+// high nibble, match length - 4 in the low nibble; 15 means more length
+// bytes follow, each added in until one is below 255), the literals, and a
+// little-endian 16-bit match offset.  The last sequence has no match.
+
+// Compress n bytes from in into out.  Returns the compressed size, or 0 if
+// it would not fit in cap bytes.
+size_t lz_compress(const uint8_t* in, size_t n, uint8_t* out, size_t cap);
+
+// Decompress n bytes from in into out, which must come to exactly out_n
+// bytes.  Returns false if the input is malformed.
+bool lz_decompress(const uint8_t* in, size_t n, uint8_t* out, size_t out_n);
+
+#endif
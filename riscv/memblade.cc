@@ -1,5 +1,6 @@
 #include "memblade.h"
 #include "sim.h"
+#include "stats.h"
 #include <cassert>
 
 bool memblade_t::load(reg_t addr, size_t len, uint8_t* bytes)
@@ -113,12 +114,43 @@ bool memblade_t::send_request(uint8_t *bytes)
       return false;
   }
 
+  requests[oc]++;
+  if (!res)
+    failed_requests++;
   memcpy(bytes, &txid, 4);
   txid++;
   nresp++;
   return true;
 }
 
+void memblade_t::dump_stats(stats_writer_t& w)
+{
+  static const char* names[MB_OC_LAST] = {
+    "page_reads", "page_writes", "word_reads", "word_writes",
+    "atomic_adds", "comp_swaps"
+  };
+  for (int i = 0; i < MB_OC_LAST; i++)
+    w.add(names[i], requests[i]);
+  w.add("failed_requests", failed_requests);
+  w.add("remote_pages", uint64_t(rmem->size()));
+}
+
+void memblade_t::read_remote(uint8_t *page)
+{
+  /* Technically, we can return anything for an unwritten page. */
+  if(!rmem->read(pageno, page))
+    memset(page, 0, remote_store_t::PAGE_SIZE);
+}
+
+bool memblade_t::write_remote(const uint8_t *page)
+{
+  if(!rmem->write(pageno, page)) {
+    memblade_err("Remote memory can't hold page 0x%lx\n", pageno);
+    return false;
+  }
+  return true;
+}
+
 bool memblade_t::page_read(void) 
 {
   memblade_info("Page Read (dst=0x%lx, pageno=0x%lx, txid=%u)\n",
@@ -132,14 +164,7 @@ bool memblade_t::page_read(void)
   }
   
   /* Find the page on the memory blade */
-  mb_rmem_t::iterator ri = rmem.find(pageno);  
-  if(ri == rmem.end()) {
-    /* Remote page has never been written to.
-     * Technically, we can write anything here. */
-    memset(client_page, 0, 4096);
-  } else {
-    memcpy(client_page, ri->second, 4096);
-  }
+  read_remote((uint8_t*)client_page);
 
   return true;
 }
@@ -149,27 +174,15 @@ bool memblade_t::page_write(void)
   memblade_info("Page Write (src=0x%lx, pageno=0x%lx, txid=%u)\n",
       src, pageno, txid);
 
-  uint8_t *rpage = NULL; // remote page
   uint8_t *lpage = NULL; // local page
 
-
   lpage = (uint8_t*)sim->addr_to_mem(src);
   if(lpage == NULL) {
     memblade_err("Invalid src address for page write: 0x%lx\n", src);
     return false;
   }
 
-  /* Use existing remote page (if it exists) or allocate new one*/
-  mb_rmem_t::iterator ri = rmem.find(pageno);  
-  if(ri != rmem.end()) {
-    rpage = ri->second;
-  } else {
-    rpage = new uint8_t[4096];
-    rmem.emplace(pageno, rpage);
-  }
-
-  memcpy(rpage, lpage, 4096);
-  return true;
+  return write_remote(lpage);
 }
 
 bool memblade_t::word_read(void)
@@ -190,14 +203,9 @@ bool memblade_t::word_read(void)
   } 
 
   /* Get the word from the memory blade */
-  mb_rmem_t::iterator ri = rmem.find(pageno);  
-  if(ri == rmem.end()) {
-    /* Remote page has never been written to.
-     * Technically, we can write anything here. */
-    memset(host_dst, 0, ext.sz);
-  } else {
-    memcpy(host_dst, ri->second + ext.off, ext.sz);
-  }
+  uint8_t rpage[remote_store_t::PAGE_SIZE];
+  read_remote(rpage);
+  memcpy(host_dst, rpage + ext.off, ext.sz);
 
   return true;
 }
@@ -213,18 +221,12 @@ bool memblade_t::word_write(void)
   memblade_info("Word Write (size=%u, offset=%u, value=%lu, pageno=0x%lx, txid=%u)\n",
       ext.sz, ext.off, ext.value, pageno, txid);
 
-  /* Use existing remote page (if it exists) or allocate new one*/
-  uint8_t *rpage = NULL; // remote page
-  mb_rmem_t::iterator ri = rmem.find(pageno);  
-  if(ri != rmem.end()) {
-    rpage = ri->second;
-  } else {
-    rpage = new uint8_t[4096];
-    rmem.emplace(pageno, rpage);
-  }
+  /* Modify a copy of the remote page, then write it back */
+  uint8_t rpage[remote_store_t::PAGE_SIZE];
+  read_remote(rpage);
 
   memcpy(rpage + ext.off, &ext.value, ext.sz);
-  return true;
+  return write_remote(rpage);
 }
 
 bool memblade_t::atomic_add(void)
@@ -238,15 +240,9 @@ bool memblade_t::atomic_add(void)
   memblade_info("Atomic Add (size=%u, offset=%u, value=%lu, pageno=0x%lx, txid=%u)\n",
       ext.sz, ext.off, ext.value, pageno, txid);
 
-  /* Use existing remote page (if it exists) or allocate new one*/
-  uint8_t *rpage = NULL; // remote page
-  mb_rmem_t::iterator ri = rmem.find(pageno);  
-  if(ri != rmem.end()) {
-    rpage = ri->second;
-  } else {
-    rpage = new uint8_t[4096];
-    rmem.emplace(pageno, rpage);
-  }
+  /* Modify a copy of the remote page, then write it back */
+  uint8_t rpage[remote_store_t::PAGE_SIZE];
+  read_remote(rpage);
 
   /* Get the destination on the client*/
   uint8_t *host_dst = ((uint8_t*)sim->addr_to_mem(dst));
@@ -281,7 +277,7 @@ bool memblade_t::atomic_add(void)
       return false;
   }
 
-  return true;
+  return write_remote(rpage);
 }
 
 /* A generic swap function */
@@ -314,15 +310,9 @@ bool memblade_t::comp_swap(void)
   memblade_info("Comp_Swap (size=%u, offset=%u, value=%lu, compValueue=%lu, pageno=0x%lx, txid=%u)\n",
       ext.sz, ext.off, ext.value, ext.compValue, pageno, txid);
 
-  /* Use existing remote page (if it exists) or allocate new one*/
-  uint8_t *rpage = NULL; // remote page
-  mb_rmem_t::iterator ri = rmem.find(pageno);  
-  if(ri != rmem.end()) {
-    rpage = ri->second;
-  } else {
-    rpage = new uint8_t[4096];
-    rmem.emplace(pageno, rpage);
-  }
+  /* Modify a copy of the remote page, then write it back */
+  uint8_t rpage[remote_store_t::PAGE_SIZE];
+  read_remote(rpage);
 
   /* Get the destination on the client*/
   uint8_t *host_dst = ((uint8_t*)sim->addr_to_mem(dst));
@@ -353,6 +343,6 @@ bool memblade_t::comp_swap(void)
       return false;
   }
 
-  return true;
+  return write_remote(rpage);
 }
 
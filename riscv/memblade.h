@@ -3,6 +3,7 @@
 
 #include "devices.h"
 #include "encoding.h"
+#include "page_store.h"
 #include "stdint.h"
 
 // #define memblade_info(M, ...) fprintf(stderr, "SPIKE Memblade: " M, ##__VA_ARGS__)
@@ -43,9 +44,6 @@ static inline uint16_t mb_ext_off(uint64_t *extdata)
   return ((extdata[0] >> 4) & 0xFFF);
 }
 
-/* first=pageno of stored page, second=pointer to 4kb buffer holding page */
-typedef std::map<reg_t, uint8_t*> mb_rmem_t;
-
 #define MB_RC_PAGE_OK 0x80
 #define MB_RC_NODATA_OK 0x81
 #define MB_RC_WORD_OK 0x82
@@ -65,6 +63,7 @@ typedef std::map<reg_t, uint8_t*> mb_rmem_t;
 
 /* Forward declare sim_t to avoid circular dep with sim.h */
 class sim_t;
+class stats_writer_t;
 
 static inline uint64_t memblade_make_exthead(int offset, int size)
 {
@@ -76,6 +75,7 @@ class memblade_t : public abstract_device_t {
   public:
     memblade_t(sim_t *host_sim) {
       sim = host_sim;
+      rmem = &local_store;
     }
 
     /* These are the standard load/store functions from abstract_device_t 
@@ -83,6 +83,12 @@ class memblade_t : public abstract_device_t {
     bool load(reg_t addr, size_t len, uint8_t* bytes);
     bool store(reg_t addr, size_t len, const uint8_t* bytes);
 
+    /* Write request counts per opcode */
+    void dump_stats(stats_writer_t& w);
+
+    /* Keep remote pages in store, which outlives the blade, from now on */
+    void set_remote_store(remote_store_t* store) { rmem = store; }
+
   private:
     sim_t *sim;
 
@@ -96,10 +102,22 @@ class memblade_t : public abstract_device_t {
     // Internal State
     uint32_t nresp = 0;
     uint32_t txid = 0;
-    mb_rmem_t rmem;
+    /* Remote pages keyed by pageno, in local_store unless another store
+     * was given */
+    page_store_t local_store;
+    remote_store_t* rmem;
+    uint64_t requests[MB_OC_LAST] = {0};
+    uint64_t failed_requests = 0;
 
     bool send_request(uint8_t *bytes);
 
+    /* Copy remote page pageno into page. A page that has never been written
+     * reads as zeros. */
+    void read_remote(uint8_t *page);
+    /* Store page as remote page pageno. Returns false if remote memory
+     * can't hold it. */
+    bool write_remote(const uint8_t *page);
+
     /* Parse a raw extended header into the expanded mb_ext_t struct.  Assumes
      * that all 3 words of the raw extended header can be safely read, even if
      * they don't contain meaningful data. */
@@ -0,0 +1,96 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_MEMBLADE_SHM_H
+#define _RISCV_MEMBLADE_SHM_H
+
+// The shared-memory protocol between simulators and spike-memblade-server,
+// which stands in for one memory blade shared by several compute nodes.
+//
+// The server creates a POSIX shared memory object holding MBSHM_CLIENTS
+// channels.  A simulator claims a free channel, then sends requests through
+// its request ring and waits for the answers on its response ring.  Each
+// ring has one producer and one consumer, so they need no locks.  Page data
+// travels through the channel's share of the page pool: a request's data
+// is in the page buffer with the same index as its request ring slot, and
+// so is a response's.
+
+#include <atomic>
+#include <cstdint>
+#include <sys/types.h>
+
+static_assert(ATOMIC_INT_LOCK_FREE == 2, "shared memory rings need lock-free atomics");
+
+#define MBSHM_MAGIC   0x314853424d4b5053ULL // "SPKMBSH1"
+#define MBSHM_CLIENTS 16
+#define MBSHM_RING    64  // descriptors per ring, a power of two
+#define MBSHM_PAGE    4096
+
+typedef enum mbshm_op {
+  MBSHM_READ,     // copy the page into the buffer; ok if it was there
+  MBSHM_WRITE,    // store the page in the buffer; ok if the blade could
+  MBSHM_CONTAINS, // ok if the page is there
+  MBSHM_ERASE,    // drop the page; ok if it was there
+} mbshm_op_t;
+
+typedef enum mbshm_state {
+  MBSHM_FREE,     // no simulator is using the channel
+  MBSHM_CLAIMED,  // a simulator is setting the channel up
+  MBSHM_ACTIVE,   // the server serves the channel
+} mbshm_state_t;
+
+typedef struct mbshm_desc {
+  uint64_t key;   // remote page number
+  uint64_t pages; // response: pages in the blade after the request
+  uint32_t op;
+  uint32_t buf;   // page buffer holding the request's data
+  uint32_t ok;    // response: see mbshm_op_t
+  uint32_t pad;
+} mbshm_desc_t;
+
+typedef struct mbshm_ring {
+  std::atomic<uint32_t> head; // next slot the producer fills
+  char pad0[60];
+  std::atomic<uint32_t> tail; // next slot the consumer takes
+  char pad1[60];
+  mbshm_desc_t desc[MBSHM_RING];
+} mbshm_ring_t;
+
+typedef struct mbshm_channel {
+  std::atomic<uint32_t> state;
+  pid_t pid;      // of the simulator using the channel
+  char pad[56];
+  mbshm_ring_t req;
+  mbshm_ring_t resp;
+  uint8_t pages[MBSHM_RING][MBSHM_PAGE];
+} mbshm_channel_t;
+
+typedef struct mbshm_region {
+  std::atomic<uint64_t> magic; // written last, once the region is ready
+  pid_t pid;      // of the server
+  char pad[52];
+  mbshm_channel_t channels[MBSHM_CLIENTS];
+} mbshm_region_t;
+
+/* Add d to ring r. Returns false if the ring is full. */
+static inline bool mbshm_push(mbshm_ring_t& r, const mbshm_desc_t& d)
+{
+  uint32_t head = r.head.load(std::memory_order_relaxed);
+  if (head - r.tail.load(std::memory_order_acquire) == MBSHM_RING)
+    return false;
+  r.desc[head % MBSHM_RING] = d;
+  r.head.store(head + 1, std::memory_order_release);
+  return true;
+}
+
+/* Take the oldest descriptor from ring r. Returns false if it is empty. */
+static inline bool mbshm_pop(mbshm_ring_t& r, mbshm_desc_t& d)
+{
+  uint32_t tail = r.tail.load(std::memory_order_relaxed);
+  if (tail == r.head.load(std::memory_order_acquire))
+    return false;
+  d = r.desc[tail % MBSHM_RING];
+  r.tail.store(tail + 1, std::memory_order_release);
+  return true;
+}
+
+#endif
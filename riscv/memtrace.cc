@@ -0,0 +1,77 @@
+// See LICENSE for license details.
+
+#include "memtrace.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+mem_trace_writer_t::mem_trace_writer_t(const char* path)
+  : buf(1 << 20), pos(0), hart(UINT32_MAX)
+{
+  file = fopen(path, "wb");
+  if (!file) {
+    fprintf(stderr, "Unable to open memory trace '%s': %s\n", path,
+            strerror(errno));
+    exit(1);
+  }
+  fwrite(MEM_TRACE_MAGIC, 1, MEM_TRACE_MAGIC_SIZE, file);
+}
+
+mem_trace_writer_t::~mem_trace_writer_t()
+{
+  flush();
+  fclose(file);
+}
+
+void mem_trace_writer_t::flush()
+{
+  if (fwrite(&buf[0], 1, pos, file) != pos) {
+    fprintf(stderr, "Error writing memory trace: %s\n", strerror(errno));
+    exit(1);
+  }
+  pos = 0;
+}
+
+void mem_trace_writer_t::record(uint32_t h, uint64_t addr, size_t bytes, access_type type)
+{
+  // header, 5-byte hart, 10-byte address
+  if (pos + 16 > buf.size())
+    flush();
+
+  uint8_t header = type | ((bytes - 1) & MEM_TRACE_SIZE_MASK) << MEM_TRACE_SIZE_SHIFT;
+  if (h != hart) {
+    buf[pos++] = header | MEM_TRACE_NEW_HART;
+    hart = h;
+    for (uint32_t x = h; ; x >>= 7) {
+      buf[pos++] = (x & 0x7f) | (x >= 0x80 ? 0x80 : 0);
+      if (x < 0x80)
+        break;
+    }
+    if (prev.size() < 3 * (hart + 1))
+      prev.resize(3 * (hart + 1));
+  } else {
+    buf[pos++] = header;
+  }
+
+  uint64_t& last = prev[3 * hart + type];
+  int64_t delta = addr - last;
+  last = addr;
+  uint64_t zz = (uint64_t(delta) << 1) ^ uint64_t(delta >> 63);
+  while (zz >= 0x80) {
+    buf[pos++] = uint8_t(zz) | 0x80;
+    zz >>= 7;
+  }
+  buf[pos++] = uint8_t(zz);
+}
+
+bool mem_trace_reader_t::open(const uint8_t* data, size_t size)
+{
+  if (size < MEM_TRACE_MAGIC_SIZE ||
+      memcmp(data, MEM_TRACE_MAGIC, MEM_TRACE_MAGIC_SIZE) != 0)
+    return false;
+  pos = data + MEM_TRACE_MAGIC_SIZE;
+  end = data + size;
+  hart = 0;
+  prev.assign(3, 0);
+  return true;
+}
@@ -0,0 +1,120 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_MEMTRACE_H
+#define _RISCV_MEMTRACE_H
+
+#include "memtracer.h"
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Compressed memory trace format, written by spike --mem-trace and read by
+// spike-cache-replay.
+//
+// The file starts with MEM_TRACE_MAGIC, followed by one record per access:
+//   header  1 byte: [1:0] access_type, [5:2] size - 1, [6] hart follows
+//   hart    LEB128, only if header bit 6 is set; applies to this and all
+//           following records
+//   addr    zigzag LEB128 of the address minus the previous address of the
+//           same type on the same hart (0 initially)
+#define MEM_TRACE_MAGIC "SPKMTRC1"
+#define MEM_TRACE_MAGIC_SIZE 8
+
+#define MEM_TRACE_TYPE_MASK  0x03
+#define MEM_TRACE_SIZE_SHIFT 2
+#define MEM_TRACE_SIZE_MASK  0x0f
+#define MEM_TRACE_NEW_HART   0x40
+
+struct mem_trace_record_t
+{
+  uint32_t hart;
+  access_type type;
+  uint8_t bytes;
+  uint64_t addr;
+};
+
+class mem_trace_writer_t
+{
+ public:
+  mem_trace_writer_t(const char* path);
+  ~mem_trace_writer_t();
+  void record(uint32_t hart, uint64_t addr, size_t bytes, access_type type);
+
+ private:
+  FILE* file;
+  std::vector<uint8_t> buf;
+  size_t pos;
+  uint32_t hart;
+  std::vector<uint64_t> prev; // last address per hart and type
+  void flush();
+};
+
+// One per hart, all feeding the same writer.
+class mem_trace_capture_t : public memtracer_t
+{
+ public:
+  mem_trace_capture_t(mem_trace_writer_t* writer, uint32_t hart)
+    : writer(writer), hart(hart) {}
+  bool interested_in_range(uint64_t begin, uint64_t end, access_type type)
+  {
+    return true;
+  }
+  void trace(uint64_t addr, size_t bytes, access_type type)
+  {
+    writer->record(hart, addr, bytes, type);
+  }
+
+ private:
+  mem_trace_writer_t* writer;
+  uint32_t hart;
+};
+
+// Decodes a trace held in memory.
+class mem_trace_reader_t
+{
+ public:
+  // Returns false if data does not start with MEM_TRACE_MAGIC.
+  bool open(const uint8_t* data, size_t size);
+  // Returns false at the end of the trace.
+  bool next(mem_trace_record_t& rec)
+  {
+    if (pos == end)
+      return false;
+
+    uint8_t h = *pos++;
+    if (h & MEM_TRACE_NEW_HART) {
+      hart = get_varint();
+      if (prev.size() < 3 * (hart + 1))
+        prev.resize(3 * (hart + 1));
+    }
+    rec.hart = hart;
+    rec.type = access_type(h & MEM_TRACE_TYPE_MASK);
+    rec.bytes = ((h >> MEM_TRACE_SIZE_SHIFT) & MEM_TRACE_SIZE_MASK) + 1;
+
+    uint64_t zz = get_varint();
+    uint64_t& last = prev[3 * hart + rec.type];
+    last += (zz >> 1) ^ -(zz & 1);
+    rec.addr = last;
+    return true;
+  }
+
+ private:
+  const uint8_t* pos;
+  const uint8_t* end;
+  uint32_t hart;
+  std::vector<uint64_t> prev;
+
+  uint64_t get_varint()
+  {
+    uint64_t x = 0;
+    for (int shift = 0; pos != end; shift += 7) {
+      uint8_t b = *pos++;
+      x |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+    return x;
+  }
+};
+
+#endif
@@ -21,6 +21,20 @@ class memtracer_t
 
   virtual bool interested_in_range(uint64_t begin, uint64_t end, access_type type) = 0;
   virtual void trace(uint64_t addr, size_t bytes, access_type type) = 0;
+  // Like trace(), also giving the PC of the instruction making the access
+  // (for FETCH, the fetch address).  Tracers that ignore the PC need not
+  // override this.
+  virtual void trace_pc(uint64_t addr, size_t bytes, access_type type, uint64_t pc)
+  {
+    trace(addr, bytes, type);
+  }
+  // Like trace_pc(), also giving the virtual address the access was made
+  // to, for models of address translation.
+  virtual void trace_vaddr(uint64_t vaddr, uint64_t paddr, size_t bytes,
+                           access_type type, uint64_t pc)
+  {
+    trace_pc(paddr, bytes, type, pc);
+  }
 };
 
 class memtracer_list_t : public memtracer_t
@@ -39,6 +53,17 @@ class memtracer_list_t : public memtracer_t
     for (std::vector<memtracer_t*>::iterator it = list.begin(); it != list.end(); ++it)
       (*it)->trace(addr, bytes, type);
   }
+  void trace_pc(uint64_t addr, size_t bytes, access_type type, uint64_t pc)
+  {
+    for (std::vector<memtracer_t*>::iterator it = list.begin(); it != list.end(); ++it)
+      (*it)->trace_pc(addr, bytes, type, pc);
+  }
+  void trace_vaddr(uint64_t vaddr, uint64_t paddr, size_t bytes,
+                   access_type type, uint64_t pc)
+  {
+    for (std::vector<memtracer_t*>::iterator it = list.begin(); it != list.end(); ++it)
+      (*it)->trace_vaddr(vaddr, paddr, bytes, type, pc);
+  }
   void hook(memtracer_t* h)
   {
     list.push_back(h);
@@ -5,7 +5,7 @@
 #include "processor.h"
 
 mmu_t::mmu_t(simif_t* sim, processor_t* proc)
- : sim(sim), proc(proc),
+ : sim(sim), proc(proc), pfa(NULL),
   check_triggers_fetch(false),
   check_triggers_load(false),
   check_triggers_store(false),
@@ -33,18 +33,64 @@ void mmu_t::flush_tlb()
   flush_icache();
 }
 
-reg_t mmu_t::translate(reg_t addr, access_type type)
+reg_t mmu_t::translation_mode(access_type type)
 {
-  if (!proc)
-    return addr;
-
   reg_t mode = proc->state.prv;
   if (type != FETCH) {
     if (!proc->state.dcsr.cause && get_field(proc->state.mstatus, MSTATUS_MPRV))
       mode = get_field(proc->state.mstatus, MSTATUS_MPP);
   }
+  return mode;
+}
 
-  return walk(addr, type, mode) | (addr & (PGSIZE-1));
+reg_t mmu_t::translate(reg_t addr, access_type type)
+{
+  if (!proc)
+    return addr;
+
+  return walk(addr, type, translation_mode(type)) | (addr & (PGSIZE-1));
+}
+
+reg_t mmu_t::vm_context(access_type type)
+{
+  if (!proc)
+    return 0;
+
+  vm_info vm = decode_vm_info(proc->max_xlen, translation_mode(type), proc->get_state()->satp);
+  return vm.levels == 0 ? 0 : proc->get_state()->satp;
+}
+
+void mmu_t::trace_walk(reg_t addr, access_type type, page_walk_t* walk)
+{
+  walk->levels = 0;
+  if (!proc)
+    return;
+
+  vm_info vm = decode_vm_info(proc->max_xlen, translation_mode(type), proc->get_state()->satp);
+  walk->pte_bytes = vm.ptesize;
+
+  reg_t base = vm.ptbase;
+  for (int i = vm.levels - 1; i >= 0; i--) {
+    int ptshift = i * vm.idxbits;
+    reg_t idx = (addr >> (PGSHIFT + ptshift)) & ((1 << vm.idxbits) - 1);
+    reg_t pte_addr = base + idx * vm.ptesize;
+    auto ppte = sim->addr_to_mem(pte_addr);
+    if (!ppte)
+      return;
+
+    walk->pte_addr[walk->levels++] = pte_addr;
+    reg_t pte = vm.ptesize == 4 ? *(uint32_t*)ppte : *(uint64_t*)ppte;
+    if (!(pte & PTE_V) || pte_is_remote(pte))
+      break;
+    if (!PTE_TABLE(pte)) {
+      walk->page_shift = PGSHIFT + ptshift;
+      return;
+    }
+    base = (pte >> PTE_PPN_SHIFT) << PGSHIFT;
+  }
+
+  // no leaf: the walk ended in a fault
+  walk->levels = 0;
 }
 
 tlb_entry_t mmu_t::fetch_slow_path(reg_t vaddr)
@@ -94,7 +140,7 @@ void mmu_t::load_slow_path(reg_t addr, reg_t len, uint8_t* bytes)
   if (auto host_addr = sim->addr_to_mem(paddr)) {
     memcpy(bytes, host_addr, len);
     if (tracer.interested_in_range(paddr, paddr + PGSIZE, LOAD))
-      tracer.trace(paddr, len, LOAD);
+      tracer.trace_vaddr(addr, paddr, len, LOAD, proc ? proc->state.pc : 0);
     else {
       refill_tlb(addr, paddr, host_addr, LOAD);
     }
@@ -124,7 +170,7 @@ void mmu_t::store_slow_path(reg_t addr, reg_t len, const uint8_t* bytes)
   if (auto host_addr = sim->addr_to_mem(paddr)) {
     memcpy(host_addr, bytes, len);
     if (tracer.interested_in_range(paddr, paddr + PGSIZE, STORE))
-      tracer.trace(paddr, len, STORE);
+      tracer.trace_vaddr(addr, paddr, len, STORE, proc ? proc->state.pc : 0);
     else
       refill_tlb(addr, paddr, host_addr, STORE);
   } else if (!sim->mmio_store(paddr, len, bytes)) {
@@ -189,9 +235,8 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode)
     reg_t ppn = pte >> PTE_PPN_SHIFT;
 
     /* Check for remote page */
-    if (pte_is_remote(pte)) {
-      sim_t *psim = dynamic_cast<sim_t *>(sim);
-      pfa_err_t pfa_res = psim->pfa->fetch_page(addr, (reg_t*)ppte);
+    if (pte_is_remote(pte) && pfa) {
+      pfa_err_t pfa_res = pfa->fetch_page(addr, (reg_t*)ppte, proc, i == 0);
       switch(pfa_res) {
         /* PFA fetched the page, resume normal MMU operation */
         case PFA_OK:
@@ -237,6 +282,10 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode)
       if ((pte & ad) != ad)
         break;
 #endif
+      /* A page the PFA prefetched may still be on its way */
+      if (pfa && proc && pfa->pages_arriving())
+        pfa->wait_for_page((reg_t*)ppte, proc);
+
       // for superpage mappings, make a fake leaf PTE for the TLB's benefit.
       reg_t vpn = addr >> PGSHIFT;
       reg_t value = (ppn | (vpn & ((reg_t(1) << ptshift) - 1))) << PGSHIFT;
@@ -35,6 +35,15 @@ struct tlb_entry_t {
   reg_t target_offset;
 };
 
+// the page-table reads a hardware walker makes for one translation
+struct page_walk_t {
+  static const size_t MAX_LEVELS = 6;
+  size_t levels;              // PTEs read; 0 if the walk faults
+  reg_t pte_addr[MAX_LEVELS]; // physical addresses, root first
+  int pte_bytes;
+  int page_shift;             // log2 size of the page mapped
+};
+
 class trigger_matched_t
 {
   public:
@@ -215,7 +224,7 @@ public:
     reg_t paddr = tlb_entry.target_offset + addr;;
     if (tracer.interested_in_range(paddr, paddr + 1, FETCH)) {
       entry->tag = -1;
-      tracer.trace(paddr, length, FETCH);
+      tracer.trace_vaddr(addr, paddr, length, FETCH, addr);
     }
     return entry;
   }
@@ -239,6 +248,15 @@ public:
 
   void register_memtracer(memtracer_t*);
 
+  // Hand remote pages met in page walks to pfa (see pfa_t::fetch_page).
+  void set_pfa(pfa_t* p) { pfa = p; }
+
+  // For target TLB models: the satp in effect for accesses of this type,
+  // or 0 if they are not translated, and the walk that translates addr,
+  // repeated without side effects.
+  reg_t vm_context(access_type type);
+  void trace_walk(reg_t addr, access_type type, page_walk_t* walk);
+
   int is_dirty_enabled()
   {
 #ifdef RISCV_ENABLE_DIRTY
@@ -260,6 +278,7 @@ public:
 private:
   simif_t* sim;
   processor_t* proc;
+  pfa_t* pfa;
   memtracer_list_t tracer;
   uint16_t fetch_temp;
 
@@ -288,6 +307,7 @@ private:
   void load_slow_path(reg_t addr, reg_t len, uint8_t* bytes);
   void store_slow_path(reg_t addr, reg_t len, const uint8_t* bytes);
   reg_t translate(reg_t addr, access_type type);
+  reg_t translation_mode(access_type type);
 
   // ITLB lookup
   inline tlb_entry_t translate_insn_addr(reg_t addr) {
@@ -0,0 +1,226 @@
+// See LICENSE for license details.
+
+#include "page_store.h"
+#include "lz.h"
+#include "stats.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+
+static uint64_t elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+static bool is_zero(const uint8_t* page)
+{
+  const uint64_t* p = (const uint64_t*)page;
+  for (size_t i = 0; i < remote_store_t::PAGE_SIZE / sizeof(uint64_t); i++)
+    if (p[i])
+      return false;
+  return true;
+}
+
+page_store_t::page_store_t()
+  : slots(MIN_SLOTS), count(0), zero_pages(false), compression(false),
+    lookups(0), probes(0), kind_pages(), stored_bytes(0), compress_ns(0),
+    decompress_ns(0)
+{
+}
+
+page_store_t::~page_store_t()
+{
+  for (uint8_t* slab : slabs)
+    munmap(slab, SLAB_SIZE);
+}
+
+size_t page_store_t::home(uint64_t key) const
+{
+  // Fibonacci hashing spreads the sequential page numbers the OS tends to
+  // hand out across the whole table.
+  return (key * 0x9e3779b97f4a7c15ULL) >> (64 - __builtin_ctzll(slots.size()));
+}
+
+page_store_t::slot_t* page_store_t::probe(uint64_t key)
+{
+  size_t mask = slots.size() - 1;
+  lookups++;
+  for (size_t i = home(key); ; i = (i + 1) & mask) {
+    probes++;
+    if (slots[i].kind == KIND_EMPTY || slots[i].key == key)
+      return &slots[i];
+  }
+}
+
+bool page_store_t::write(uint64_t key, const uint8_t* page)
+{
+  slot_t* s = probe(key);
+  if (s->kind != KIND_EMPTY) {
+    free_chunk(s);
+    kind_pages[s->kind]--;
+  } else {
+    if ((count + 1) * 4 > slots.size() * 3) {
+      grow();
+      s = probe(key);
+    }
+    count++;
+  }
+  s->key = key;
+
+  if (zero_pages && is_zero(page)) {
+    s->kind = KIND_ZERO;
+    s->data = NULL;
+    s->len = 0;
+  } else {
+    // a page is only kept compressed if that saves at least one chunk size
+    uint8_t buf[PAGE_SIZE - CHUNK_GRAIN];
+    size_t len = 0;
+    if (compression) {
+      auto start = std::chrono::steady_clock::now();
+      len = lz_compress(page, PAGE_SIZE, buf, sizeof buf);
+      compress_ns += elapsed_ns(start);
+    }
+    if (len) {
+      s->kind = KIND_LZ;
+      s->len = len;
+      s->data = alloc_chunk(len);
+      memcpy(s->data, buf, len);
+    } else {
+      s->kind = KIND_RAW;
+      s->len = PAGE_SIZE;
+      s->data = alloc_chunk(PAGE_SIZE);
+      memcpy(s->data, page, PAGE_SIZE);
+    }
+  }
+  kind_pages[s->kind]++;
+  return true;
+}
+
+bool page_store_t::read(uint64_t key, uint8_t* page)
+{
+  slot_t* s = probe(key);
+  switch (s->kind) {
+    case KIND_EMPTY:
+      return false;
+    case KIND_ZERO:
+      memset(page, 0, PAGE_SIZE);
+      return true;
+    case KIND_RAW:
+      memcpy(page, s->data, PAGE_SIZE);
+      return true;
+    case KIND_LZ: {
+      auto start = std::chrono::steady_clock::now();
+      bool ok = lz_decompress(s->data, s->len, page, PAGE_SIZE);
+      decompress_ns += elapsed_ns(start);
+      if (!ok) {
+        fprintf(stderr, "page store: page 0x%lx is corrupt\n", (unsigned long)key);
+        abort();
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool page_store_t::erase(uint64_t key)
+{
+  slot_t* s = probe(key);
+  if (s->kind == KIND_EMPTY)
+    return false;
+
+  free_chunk(s);
+  kind_pages[s->kind]--;
+  count--;
+
+  // Backward-shift deletion: pull later members of the probe run into the
+  // hole so lookups never need tombstones.
+  size_t mask = slots.size() - 1;
+  size_t hole = s - &slots[0];
+  for (size_t i = (hole + 1) & mask; slots[i].kind != KIND_EMPTY; i = (i + 1) & mask) {
+    size_t h = home(slots[i].key);
+    if (((i - h) & mask) >= ((i - hole) & mask)) {
+      slots[hole] = slots[i];
+      hole = i;
+    }
+  }
+  slots[hole].kind = KIND_EMPTY;
+  return true;
+}
+
+void page_store_t::grow()
+{
+  std::vector<slot_t> old(slots.size() * 2);
+  old.swap(slots);
+  size_t mask = slots.size() - 1;
+  for (const slot_t& o : old) {
+    if (o.kind == KIND_EMPTY)
+      continue;
+    size_t i = home(o.key);
+    while (slots[i].kind != KIND_EMPTY)
+      i = (i + 1) & mask;
+    slots[i] = o;
+  }
+}
+
+size_t page_store_t::chunk_size(size_t len)
+{
+  return (len + CHUNK_GRAIN - 1) / CHUNK_GRAIN * CHUNK_GRAIN;
+}
+
+uint8_t* page_store_t::alloc_chunk(size_t len)
+{
+  size_t size = chunk_size(len);
+  std::vector<uint8_t*>& free_list = free_chunks[size / CHUNK_GRAIN - 1];
+
+  if (free_list.empty()) {
+    void* slab = mmap(NULL, SLAB_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (slab == MAP_FAILED) {
+      fprintf(stderr, "page store: out of memory after %zu pages\n", count);
+      exit(1);
+    }
+    slabs.push_back((uint8_t*)slab);
+    // hand chunks out in address order
+    for (size_t i = SLAB_SIZE / size; i > 0; i--)
+      free_list.push_back((uint8_t*)slab + (i - 1) * size);
+  }
+
+  uint8_t* chunk = free_list.back();
+  free_list.pop_back();
+  stored_bytes += size;
+  return chunk;
+}
+
+void page_store_t::free_chunk(slot_t* s)
+{
+  if (!s->data)
+    return;
+  size_t size = chunk_size(s->len);
+  free_chunks[size / CHUNK_GRAIN - 1].push_back(s->data);
+  stored_bytes -= size;
+}
+
+void page_store_t::dump_stats(stats_writer_t& w)
+{
+  uint64_t free_bytes = 0;
+  for (size_t i = 0; i < NCLASSES; i++)
+    free_bytes += free_chunks[i].size() * (i + 1) * CHUNK_GRAIN;
+
+  w.add("pages", uint64_t(count));
+  w.add("zero_pages", kind_pages[KIND_ZERO]);
+  w.add("compressed_pages", kind_pages[KIND_LZ]);
+  w.add("raw_pages", kind_pages[KIND_RAW]);
+  w.add("stored_bytes", stored_bytes);
+  w.add("compression_ratio", double(count * PAGE_SIZE) / stored_bytes);
+  w.add("compress_ns", compress_ns);
+  w.add("decompress_ns", decompress_ns);
+  w.add("free_bytes", free_bytes);
+  w.add("slabs", uint64_t(slabs.size()));
+  w.add("slab_bytes", uint64_t(slabs.size() * SLAB_SIZE));
+  w.add("table_slots", uint64_t(slots.size()));
+  w.add("load_factor", double(count) / slots.size());
+  w.add("probes_per_lookup", lookups ? double(probes) / lookups : 0.0);
+}
@@ -0,0 +1,75 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_PAGE_STORE_H
+#define _RISCV_PAGE_STORE_H
+
+#include "remote_store.h"
+#include <vector>
+
+// A store of 4 KiB pages keyed by remote page number.  Page data lives in
+// chunks carved out of page-aligned slabs and recycled through free lists,
+// and the index is an open-addressing hash table with linear probing, so
+// neither lookups nor replacing a page touch the host allocator.
+//
+// Optionally, all-zero pages are kept as a flag with no data, and other
+// pages are LZ-compressed into the smallest chunk size that holds them.
+class page_store_t : public remote_store_t
+{
+ public:
+  page_store_t();
+  ~page_store_t();
+
+  void set_zero_pages(bool enable) { zero_pages = enable; }
+  void set_compression(bool enable) { compression = enable; }
+
+  bool write(uint64_t key, const uint8_t* page);
+  bool read(uint64_t key, uint8_t* page);
+  bool contains(uint64_t key) { return probe(key)->kind != KIND_EMPTY; }
+  // Drop the page stored under key, returning its memory to the free lists.
+  bool erase(uint64_t key);
+
+  size_t size() const { return count; }
+  void dump_stats(stats_writer_t& w);
+
+ private:
+  static const size_t SLAB_SIZE = 1 << 20;
+  static const size_t CHUNK_GRAIN = 256; // chunk sizes are multiples of this
+  static const size_t NCLASSES = PAGE_SIZE / CHUNK_GRAIN;
+  static const size_t MIN_SLOTS = 1024;
+
+  enum kind_t : uint8_t { KIND_EMPTY, KIND_ZERO, KIND_RAW, KIND_LZ };
+
+  struct slot_t {
+    uint64_t key;
+    uint8_t* data;  // NULL for zero pages
+    uint16_t len;   // bytes of data used (compressed size if KIND_LZ)
+    kind_t kind;
+  };
+
+  std::vector<slot_t> slots; // a power of two, at most 3/4 full
+  size_t count;
+  std::vector<uint8_t*> slabs;
+  std::vector<uint8_t*> free_chunks[NCLASSES]; // by (size / CHUNK_GRAIN) - 1
+
+  bool zero_pages;
+  bool compression;
+
+  uint64_t lookups;
+  uint64_t probes;
+  uint64_t kind_pages[4];   // live pages of each kind
+  uint64_t stored_bytes;    // chunk bytes held by live pages
+  uint64_t compress_ns;     // host time spent compressing and decompressing
+  uint64_t decompress_ns;
+
+  size_t home(uint64_t key) const;
+  slot_t* probe(uint64_t key);
+  void grow();
+  static size_t chunk_size(size_t len);
+  uint8_t* alloc_chunk(size_t len);
+  void free_chunk(slot_t* s);
+
+  page_store_t(const page_store_t&) = delete;
+  page_store_t& operator=(const page_store_t&) = delete;
+};
+
+#endif
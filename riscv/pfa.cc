@@ -1,7 +1,13 @@
 #include "pfa.h"
+#include "config_list.h"
 #include "sim.h"
 #include "mmu.h"
+#include "stats.h"
+#include "timing.h"
+#include <algorithm>
 #include <cassert>
+#include <cstdlib>
+#include <string>
 
 const char* const _pfa_port_names[PFA_NPORTS] = {
   "FREE_FRAME",
@@ -11,9 +17,51 @@ const char* const _pfa_port_names[PFA_NPORTS] = {
   "NEW_PGID",
   "NEW_VADDR",
   "NEW_STAT",
+  "DSTMAC",
+  "BATCH_ADDR",
+  "EVICT_BATCH",
+  "FREE_BATCH",
+  "NEW_RING",
 };
 
+static void help()
+{
+  fprintf(stderr, "PFA configurations must be comma-separated lists of\n");
+  fprintf(stderr, "  name=value\n");
+  fprintf(stderr, "where name is evict-latency (instructions), evict-bandwidth\n");
+  fprintf(stderr, "(bytes per instruction), fetch-latency (cycles) or\n");
+  fprintf(stderr, "fetch-bandwidth (bytes per cycle), where a bandwidth of 0 is\n");
+  fprintf(stderr, "unlimited; or zero-pages or compress (1 to store all-zero pages\n");
+  fprintf(stderr, "as a flag, or to LZ-compress remote pages, in host memory);\n");
+  fprintf(stderr, "or prefetch (remote pages to fetch after each faulting one);\n");
+  fprintf(stderr, "or page-stats (1 to track every remote page for statistics).\n");
+  exit(1);
+}
+
+void pfa_config_t::parse(const char* spec)
+{
+  parse_config_list(spec, [this](const std::string& name, uint64_t value) {
+    if (name == "evict-latency") evict_latency = value;
+    else if (name == "evict-bandwidth") evict_bandwidth = value;
+    else if (name == "fetch-latency") fetch_latency = value;
+    else if (name == "fetch-bandwidth") fetch_bandwidth = value;
+    else if (name == "zero-pages") zero_pages = value;
+    else if (name == "compress") compress = value;
+    else if (name == "prefetch") prefetch = value;
+    else if (name == "page-stats") page_stats = value;
+    else return false;
+    return true;
+  }, &help);
+}
+
 /* Generic Helpers */
+
+/* Frame paddr of a packed EVICT value. See spec for details of the format */
+static uint64_t evict_val_paddr(uint64_t evict_val)
+{
+  return (evict_val << 28) >> 16;
+}
+
 reg_t pfa_mk_local_pte(reg_t rem_pte, uintptr_t paddr)
 {
   reg_t local_pte;
@@ -26,22 +74,47 @@ reg_t pfa_mk_local_pte(reg_t rem_pte, uintptr_t paddr)
   return local_pte;
 }
 
+pfa_t::pfa_t(sim_t *host_sim)
+  : sim(host_sim), queues(host_sim->procs.size()), rmem(&local_store)
+{
+}
+
+pfa_hart_queues_t* pfa_t::hart_queues(reg_t& addr)
+{
+  size_t hart = addr / PFA_HART_STRIDE;
+  addr %= PFA_HART_STRIDE;
+  if(hart >= queues.size()) {
+    pfa_err("Access to PFA ports of nonexistent hart %ld\n", hart);
+    return NULL;
+  }
+  return &queues[hart];
+}
+
 bool pfa_t::load(reg_t addr, size_t len, uint8_t* bytes)
 {
   /* Only word-sized values accepted */
   assert(len == sizeof(reg_t));
 
+  pfa_hart_queues_t* q = hart_queues(addr);
+  if(q == NULL)
+    return false;
+  sync_time(*q);
+  mmio_loads++;
+
   switch(addr) {
     case PFA_FREESTAT:
-      return free_check_size(bytes);
+      return free_check_size(*q, bytes);
     case PFA_EVICTSTAT:
-      return evict_check_size(bytes);
+      return evict_check_size(*q, bytes);
     case PFA_NEWPGID:
-      return pop_newpgid(bytes);
+      return pop_newpgid(*q, bytes);
     case PFA_NEWVADDR:
-      return pop_newvaddr(bytes);
+      return pop_newvaddr(*q, bytes);
     case PFA_NEWSTAT:
-      return check_newpage(bytes);
+      return check_newpage(*q, bytes);
+    case PFA_BATCHADDR:
+      memcpy(bytes, &q->batch_addr, sizeof(reg_t));
+      return true;
     default:
       if(addr % 8 != 0 || addr > PFA_PORT_LAST) {
         pfa_err("Unrecognized load to PFA offset %ld\n", addr);
@@ -60,17 +133,36 @@ bool pfa_t::store(reg_t addr, size_t len, const uint8_t* bytes)
   /* Only word-sized values accepted */
   assert(len == sizeof(reg_t));
 
+  pfa_hart_queues_t* q = hart_queues(addr);
+  if(q == NULL)
+    return false;
+  sync_time(*q);
+  mmio_stores++;
+
   switch(addr) {
     case PFA_FREEFRAME:
-      return free_frame(bytes);
+      return free_frame(*q, bytes);
 
     case PFA_EVICTPAGE:
-      return evict_page(bytes);
+      return evict_page(*q, bytes);
 
     case PFA_DSTMAC:
       /* Spike ignores this field */
       return true;
 
+    case PFA_BATCHADDR:
+      memcpy(&q->batch_addr, bytes, sizeof(reg_t));
+      return true;
+
+    case PFA_EVICTBATCH:
+      return evict_batch(*q, bytes);
+
+    case PFA_FREEBATCH:
+      return free_batch(*q, bytes);
+
+    case PFA_NEWRING:
+      return set_new_ring(*q, bytes);
+
     default:
       if(addr % 8 != 0 || addr > PFA_PORT_LAST) {
         pfa_err("Unrecognized store to PFA offset %ld\n", addr);
@@ -84,69 +176,271 @@ bool pfa_t::store(reg_t addr, size_t len, const uint8_t* bytes)
   return true;
 }
 
-pfa_err_t pfa_t::fetch_page(reg_t vaddr, reg_t *host_pte)
+pfa_err_t pfa_t::fetch_page(reg_t vaddr, reg_t *host_pte, processor_t* proc,
+                            bool leaf)
 {
   vaddr &= PGMASK;
 
+  pfa_hart_queues_t& q = proc ? proc_queues(proc) : queues[0];
+  if(proc)
+    sync_time(q);
+
+  faults++;
+  free_at_fault.add(q.freeq.size());
+  new_at_fault.add(new_waiting(q));
+
   /* Basic feasibility checks */
-  if(freeq.empty()){
+  if(q.freeq.empty()){
     pfa_info("No available free frame for (vaddr=0x%lx)\n", vaddr);
+    no_free++;
     return PFA_NO_FREE;
   }
-  if(new_pgid_q.size() == PFA_NEW_MAX || new_vaddr_q.size() == PFA_NEW_MAX) {
+  if(new_full(q)) {
     pfa_info("No free slots in new page queue for (vaddr=0x%lx)\n", vaddr);
+    no_new++;
     return PFA_NO_NEW;
   }
   
-  pgid_t pageid = pfa_remote_get_pageid(*host_pte);
+  reg_t rem_pte = *host_pte;
+  pgid_t pageid = pfa_remote_get_pageid(rem_pte);
   uint64_t rem_ppn = pfa_pgid_to_ppn(pageid);
 
-  if(eviction_in_progress && eviction_rem_ppn == rem_ppn) {
+  complete_evictions(q);
+  if(eviction_pending(rem_ppn)) {
     pfa_err("Fetching page before eviction is complete\n");
     return PFA_ERR;
   }
 
-  /* Get the remote page (if it exists) */
-  rmem_t::iterator ri = rmem.find(rem_ppn);
-  if(ri == rmem.end()) {
+  /* Check the remote page exists */
+  if(!rmem->contains(rem_ppn)) {
     /* not found */
     pfa_err("Requested (vaddr=0x%lx, pgid=0x%lx, rpn=0x%lx) not in remote memory\n", vaddr, pageid, rem_ppn);
+    no_page++;
     return PFA_NO_PAGE;
   }
 
-  reg_t paddr = freeq.front();
-  freeq.pop();
+  /* Any earlier prefetch of this pte has been evicted again since */
+  if(!arriving.empty())
+    arriving.erase(host_pte);
 
-  /* Update the new queues */
-  new_pgid_q.push(pageid);
-  new_vaddr_q.push(vaddr);
+  install_page(q, vaddr, host_pte, rem_pte, false);
+  fetches++;
+  if(proc)
+    charge_fetch(q, proc);
 
-  /* Assign ppn to pte and make local*/
-  *host_pte = pfa_mk_local_pte(*host_pte, paddr);
+  if(config.prefetch && leaf)
+    prefetch(q, vaddr, host_pte, proc);
 
-  pfa_info("fetching (vaddr=0x%lx) into (paddr=0x%lx), (pgid=0x%lx), (pte=0x%lx)\n",
-      vaddr, paddr, pageid, *host_pte);
+  return PFA_OK;
+}
 
-  /* Copy over remote data into new frame */
-  void *host_page = (void*)sim->addr_to_mem(paddr);
-  if(host_page == NULL) {
-    pfa_err("fetching bad physical address: (paddr=%lx)\n", paddr);
-    return PFA_ERR;
+void pfa_t::install_page(pfa_hart_queues_t& q, reg_t vaddr, reg_t* host_pte,
+                         reg_t rem_pte, bool prefetched)
+{
+  pgid_t pageid = pfa_remote_get_pageid(rem_pte);
+  uint64_t rem_ppn = pfa_pgid_to_ppn(pageid);
+
+  /* free_frame only accepts frames in memory */
+  reg_t paddr = q.freeq.front();
+  q.freeq.pop();
+
+  /* Copy over remote data into new frame before the pte makes it visible */
+  rmem->read(rem_ppn, (uint8_t*)sim->addr_to_mem(paddr));
+
+  /* Assign ppn to pte and make local */
+  reg_t local_pte = pfa_mk_local_pte(rem_pte, paddr);
+  *host_pte = local_pte;
+
+  pfa_info("%s (vaddr=0x%lx) into (paddr=0x%lx), (pgid=0x%lx), (pte=0x%lx)\n",
+      prefetched ? "prefetching" : "fetching", vaddr, paddr, pageid, local_pte);
+
+  push_new(q, prefetched ? pageid | PFA_NEW_PREFETCHED : pageid, vaddr);
+
+  rmem->erase(rem_ppn);
+
+  hot_pages.add(rem_ppn);
+  if(config.page_stats) {
+    auto e = evicted_at.find(rem_ppn);
+    if(e != evicted_at.end()) {
+      /* The harts' clocks may be a little apart */
+      uint64_t t = hart_time(q);
+      evict_to_fetch.add(t > e->second ? t - e->second : 0);
+      evicted_at.erase(e);
+    }
+    if(page_fetches[rem_ppn]++)
+      refetches++;
   }
-  memcpy(host_page, ri->second, 4096);
-  
-  return PFA_OK;
 }
 
-bool pfa_t::pop_newpgid(uint8_t *bytes)
+void pfa_t::prefetch(pfa_hart_queues_t& q, reg_t vaddr, reg_t* host_pte,
+                     processor_t* proc)
+{
+  /* A fault just past the pages prefetched last time continues that
+   * stream. Otherwise follow the stride between this hart's faults once it
+   * repeats, or assume a sequential scan. */
+  reg_t vpn = vaddr >> PGSHIFT;
+  if(vpn != q.next_vpn) {
+    int64_t delta = vpn - q.last_fault_vpn;
+    q.stride = delta && delta == q.last_delta ? delta : 1;
+    q.last_delta = delta;
+  }
+  q.last_fault_vpn = vpn;
+
+  /* Only ptes in the faulting page's leaf table can be reached without a
+   * page walk */
+  int64_t idx = vpn % (PGSIZE / sizeof(reg_t));
+  uint64_t i;
+  for(i = 1; i <= config.prefetch; i++) {
+    int64_t off = i * q.stride;
+    if(idx + off < 0 || idx + off >= int64_t(PGSIZE / sizeof(reg_t)))
+      break;
+    if(q.freeq.empty() || new_full(q))
+      break;
+
+    reg_t* pte = host_pte + off;
+    reg_t rem_pte = *pte;
+    if(!pte_is_remote(rem_pte))
+      continue;
+    uint64_t rem_ppn = pfa_pgid_to_ppn(pfa_remote_get_pageid(rem_pte));
+    if(eviction_pending(rem_ppn) || !rmem->contains(rem_ppn))
+      continue;
+
+    install_page(q, vaddr + off * PGSIZE, pte, rem_pte, true);
+    prefetches++;
+
+    /* Prefetched pages follow the demand page over the link. The hart
+     * doesn't wait for them unless it touches one before it arrives (see
+     * wait_for_page), but later fetches queue behind them. */
+    if(proc) {
+      reserve_fetch_link(fetch_link_free);
+      uint64_t arrival = fetch_link_free + config.fetch_latency;
+      if(arrival > hart_time(q))
+        arriving[pte] = arrival;
+    }
+  }
+
+  /* Forget pages that arrived without being touched */
+  if(proc && arriving.size() > PFA_FREE_MAX) {
+    uint64_t t = hart_time(q);
+    for(auto a = arriving.begin(); a != arriving.end(); )
+      a = a->second <= t ? arriving.erase(a) : std::next(a);
+  }
+  q.next_vpn = vpn + i * q.stride;
+}
+
+void pfa_t::set_config(const pfa_config_t& c)
+{
+  config = c;
+  local_store.set_zero_pages(c.zero_pages);
+  local_store.set_compression(c.compress);
+}
+
+uint64_t pfa_t::reserve_fetch_link(uint64_t t)
+{
+  uint64_t start = std::max(t, fetch_link_free);
+  fetch_link_free = start;
+  if(config.fetch_bandwidth)
+    fetch_link_free += (4096 + config.fetch_bandwidth - 1) / config.fetch_bandwidth;
+  return start;
+}
+
+pfa_hart_queues_t& pfa_t::proc_queues(processor_t* proc)
+{
+  size_t hart = std::find(sim->procs.begin(), sim->procs.end(), proc) - sim->procs.begin();
+  return queues[hart];
+}
+
+void pfa_t::wait_for_page(reg_t* host_pte, processor_t* proc)
+{
+  auto a = arriving.find(host_pte);
+  if(a == arriving.end())
+    return;
+  pfa_hart_queues_t& q = proc_queues(proc);
+  sync_time(q);
+  uint64_t arrival = a->second;
+  arriving.erase(a);
+
+  uint64_t t = hart_time(q);
+  if(arrival <= t)
+    return;
+
+  uint64_t stall = arrival - t;
+  prefetch_waits++;
+  prefetch_wait_stalls += stall;
+  q.stalled += stall;
+  q.idle += stall;
+  if(proc->get_timing())
+    proc->get_timing()->remote_wait(stall);
+}
+
+void pfa_t::charge_fetch(pfa_hart_queues_t& q, processor_t* proc)
+{
+  /* Pages cross the shared link one at a time, then take the latency */
+  uint64_t t = hart_time(q);
+  uint64_t start = reserve_fetch_link(t);
+  uint64_t stall = fetch_link_free + config.fetch_latency - t;
+
+  fetch_stalls += stall;
+  fetch_queueing += start - t;
+  max_fetch_stall = std::max(max_fetch_stall, stall);
+
+  /* The hart sits the stall out, so mtime and the other harts move on */
+  q.stalled += stall;
+  q.idle += stall;
+  if(proc->get_timing())
+    proc->get_timing()->remote_fetch(stall);
+}
+
+void pfa_t::dump_stats(stats_writer_t& w)
+{
+  w.add("fetches", fetches);
+  w.add("prefetches", prefetches);
+  w.add("prefetch_waits", prefetch_waits);
+  w.add("prefetch_wait_stalls", prefetch_wait_stalls);
+  w.add("evictions", evictions);
+  w.add("lost_evictions", lost_evictions);
+  w.add("evict_queue", uint64_t(evictq.size()));
+  w.add("mmio_loads", mmio_loads);
+  w.add("mmio_stores", mmio_stores);
+  w.add("evict_batches", evict_batches);
+  w.add("free_batches", free_batches);
+  w.add("fetch_stalls", fetch_stalls);
+  w.add("fetch_queueing", fetch_queueing);
+  w.add("max_fetch_stall", max_fetch_stall);
+  uint64_t free_frames = 0, new_pages = 0;
+  for(auto& q : queues) {
+    free_frames += q.freeq.size();
+    new_pages += new_waiting(q);
+  }
+  w.add("free_frames", free_frames);
+  w.add("new_pages", new_pages);
+
+  w.add("faults", faults);
+  w.add("no_free", no_free);
+  w.add("no_new", no_new);
+  w.add("no_page", no_page);
+  free_at_fault.dump(w, "free_frames_at_fault");
+  new_at_fault.dump(w, "new_pages_at_fault");
+  if(config.page_stats) {
+    evict_to_fetch.dump(w, "evict_to_fetch");
+    w.add("refetches", refetches);
+  }
+  hot_pages.dump(w, "hot_pages", PFA_HOT_PAGES);
+
+  w.begin("remote_store");
+  rmem->dump_stats(w);
+  w.end();
+}
+
+bool pfa_t::pop_newpgid(pfa_hart_queues_t& q, uint8_t *bytes)
 {
   pgid_t pgid;
-  if(new_pgid_q.empty()) {
+  if(q.new_pgid_q.empty()) {
     pfa_err("Reading from empty newpgid queue\n");
     return false;
   }  else {
-    pgid = new_pgid_q.front();
-    new_pgid_q.pop();
+    pgid = q.new_pgid_q.front();
+    q.new_pgid_q.pop();
   }
 
   pfa_info("Reporting newpage (pgid=0x%lx)\n", pgid);
@@ -155,16 +449,16 @@ bool pfa_t::pop_newpgid(uint8_t *bytes)
   return true;
 }
 
-bool pfa_t::pop_newvaddr(uint8_t *bytes)
+bool pfa_t::pop_newvaddr(pfa_hart_queues_t& q, uint8_t *bytes)
 {
 
   reg_t vaddr;
-  if(new_vaddr_q.empty()) {
+  if(q.new_vaddr_q.empty()) {
     pfa_err("Reading from empty newvaddr queue\n");
     return false;
   }  else {
-    vaddr = new_vaddr_q.front();
-    new_vaddr_q.pop();
+    vaddr = q.new_vaddr_q.front();
+    q.new_vaddr_q.pop();
   }
 
   pfa_info("Reporting newpage (vaddr=0x%lx)\n", vaddr);
@@ -172,75 +466,185 @@ bool pfa_t::pop_newvaddr(uint8_t *bytes)
   return true;
 }
 
-bool pfa_t::check_newpage(uint8_t *bytes)
+bool pfa_t::check_newpage(pfa_hart_queues_t& q, uint8_t *bytes)
 {
-  reg_t nnew = (reg_t)new_pgid_q.size();
+  reg_t nnew = new_waiting(q);
   // pfa_info("Reporting %ld new pages\n", nnew);
   memcpy(bytes, &nnew, sizeof(reg_t));
   return true;
 }
 
-bool pfa_t::evict_check_size(uint8_t *bytes)
+/* A new page ring is a header of four words (head, written by the PFA;
+ * tail, written by the OS; size; reserved) followed by size records of two
+ * words (pgid, vaddr). Record i is in slot i % size. */
+uint64_t pfa_t::new_waiting(pfa_hart_queues_t& q)
 {
-  /* Simulate polling for completion for one cycle only (eviction is actually
-   * synchronous) */
-  if(eviction_in_progress) {
-    *((reg_t*)bytes) = PFA_EVICT_MAX - 1;
-    eviction_in_progress = false;
-  } else {
-      *((reg_t*)bytes) = PFA_EVICT_MAX;
+  if(!q.new_ring)
+    return q.new_pgid_q.size();
+  return q.new_ring[0] - q.new_ring[1];
+}
+
+bool pfa_t::new_full(pfa_hart_queues_t& q)
+{
+  if(!q.new_ring)
+    return q.new_pgid_q.size() == PFA_NEW_MAX || q.new_vaddr_q.size() == PFA_NEW_MAX;
+  return new_waiting(q) >= q.new_ring_size;
+}
+
+void pfa_t::push_new(pfa_hart_queues_t& q, pgid_t pgid, reg_t vaddr)
+{
+  if(!q.new_ring) {
+    q.new_pgid_q.push(pgid);
+    q.new_vaddr_q.push(vaddr);
+    return;
+  }
+
+  /* Guest memory is only touched from the thread running the harts, so
+   * the OS sees the record and the new head together */
+  uint64_t head = q.new_ring[0];
+  uint64_t* rec = q.new_ring + 4 + 2 * (head & (q.new_ring_size - 1));
+  rec[0] = pgid;
+  rec[1] = vaddr;
+  q.new_ring[0] = head + 1;
+}
+
+bool pfa_t::set_new_ring(pfa_hart_queues_t& q, const uint8_t *bytes)
+{
+  reg_t paddr;
+  memcpy(&paddr, bytes, sizeof(reg_t));
+  if(paddr == 0) {
+    q.new_ring = NULL;
+    return true;
+  }
+
+  uint64_t* ring = (uint64_t*)sim->addr_to_mem(paddr);
+  if(paddr % 8 != 0 || !ring) {
+    pfa_err("Invalid paddr for new page ring (paddr=0x%lx)\n", paddr);
+    return false;
+  }
+  uint64_t size = ring[2];
+  if(size == 0 || (size & (size - 1)) || size > (1ul << 32)) {
+    pfa_err("Invalid new page ring size %ld\n", size);
+    return false;
+  }
+  reg_t last = paddr + (4 + 2 * size) * sizeof(uint64_t) - 1;
+  if((char*)sim->addr_to_mem(last) != (char*)ring + (last - paddr)) {
+    pfa_err("New page ring at (paddr=0x%lx) is not all in memory\n", paddr);
+    return false;
+  }
+
+  pfa_info("New pages go to ring at (paddr=0x%lx) of %ld records\n", paddr, size);
+  q.new_ring = ring;
+  q.new_ring_size = size;
+  return true;
+}
+
+uint64_t pfa_t::hart_time(pfa_hart_queues_t& q)
+{
+  return sim->procs[&q - &queues[0]]->get_state()->minstret + q.stalled;
+}
+
+void pfa_t::sync_time(pfa_hart_queues_t& q)
+{
+  sim->procs[&q - &queues[0]]->sync_instret();
+}
+
+void pfa_t::complete_evictions(pfa_hart_queues_t& q)
+{
+  if(evictq.empty())
+    return;
+
+  uint64_t t = hart_time(q);
+  while(!evictq.empty() && evictq.front().done <= t)
+    finish_eviction();
+}
+
+void pfa_t::flush_evictions()
+{
+  while(!evictq.empty())
+    finish_eviction();
+}
+
+void pfa_t::finish_eviction()
+{
+  pfa_evict_t& e = evictq.front();
+  /* Copy page out to remote buffer (replacing any existing entry) */
+  if(!rmem->write(e.rem_ppn, (uint8_t*)sim->addr_to_mem(e.paddr))) {
+    pfa_err("Remote memory lost evicted page (rpn=0x%lx)\n", e.rem_ppn);
+    lost_evictions++;
+  }
+  pfa_info("Evicted page at (paddr=0x%lx) (rpn=0x%lx)\n", e.paddr, e.rem_ppn);
+  evictq.pop_front();
+}
+
+bool pfa_t::eviction_pending(pgid_t rem_ppn)
+{
+  for(auto& e : evictq) {
+    if(e.rem_ppn == rem_ppn)
+      return true;
   }
+  return false;
+}
+
+bool pfa_t::evict_check_size(pfa_hart_queues_t& q, uint8_t *bytes)
+{
+  complete_evictions(q);
+  *((reg_t*)bytes) = PFA_EVICT_MAX - evictq.size();
   return true;
 }
 
-bool pfa_t::evict_page(const uint8_t *bytes)
+bool pfa_t::evict_page(pfa_hart_queues_t& q, const uint8_t *bytes)
 {
   uint64_t evict_val;
 
-  if(eviction_in_progress) {
-    pfa_err("Evicting again without polling for the previous completion\n");
+  complete_evictions(q);
+  if(evictq.size() == PFA_EVICT_MAX) {
+    pfa_err("Attempted to push to full evict queue\n");
     return false;
   }
 
   memcpy(&evict_val, bytes, sizeof(reg_t));
 
   /* Extract the paddr and pgid. See spec for details of evict_val format */
-  uint64_t paddr = (evict_val << 28) >> 16;
+  uint64_t paddr = evict_val_paddr(evict_val);
   pgid_t rem_ppn  = (evict_val >> 36);
 
-  /* Copy page out to remote buffer */
-  uint8_t *page_val = new uint8_t[4096];
-  void *host_page = (void*)sim->addr_to_mem(paddr);
-  if(host_page == NULL) {
+  if(sim->addr_to_mem(paddr) == NULL) {
     pfa_err("Invalid paddr for evicted page (paddr=0x%lx)\n", paddr);
     return false;
   }
-  memcpy(page_val, host_page, 4096);
-
-  auto res = rmem.emplace(rem_ppn, page_val);
-  if(res.second == false) {
-    /* Replacing an existing entry */
-    auto ri = res.first;
-    delete [] ri->second;
-    ri->second = page_val;
+  if(rem_ppn >= rmem->key_limit()) {
+    pfa_err("Remote memory can't hold evicted page (rpn=0x%lx)\n", rem_ppn);
+    return false;
   }
 
-  eviction_in_progress = true;
-  eviction_rem_ppn = rem_ppn;
+  /* Pages cross the link one at a time, then take the latency to land */
+  uint64_t t = hart_time(q);
+  uint64_t start = std::max(t, evict_link_free);
+  evict_link_free = start;
+  if(config.evict_bandwidth)
+    evict_link_free += (4096 + config.evict_bandwidth - 1) / config.evict_bandwidth;
+  evictq.push_back({paddr, rem_ppn, evict_link_free + config.evict_latency});
+
+  evictions++;
+  if(config.page_stats)
+    evicted_at[rem_ppn] = t;
   pfa_info("Evicting page at (paddr=0x%lx) (rpn=0x%lx)\n", paddr, rem_ppn);
 
+  /* Without a link model the eviction is done as soon as it is queued */
+  complete_evictions(q);
   return true;
 }
 
-bool pfa_t::free_check_size(uint8_t *bytes)
+bool pfa_t::free_check_size(pfa_hart_queues_t& q, uint8_t *bytes)
 {
-  *((reg_t*)bytes) = PFA_FREE_MAX - freeq.size();
+  *((reg_t*)bytes) = PFA_FREE_MAX - q.freeq.size();
   return true;
 }
 
-bool pfa_t::free_frame(const uint8_t *bytes)
+bool pfa_t::free_frame(pfa_hart_queues_t& q, const uint8_t *bytes)
 {
-  if(freeq.size() <= PFA_FREE_MAX) {
+  if(q.freeq.size() < PFA_FREE_MAX) {
     reg_t paddr;
     memcpy(&paddr, bytes, sizeof(reg_t));
     
@@ -250,10 +654,83 @@ bool pfa_t::free_frame(const uint8_t *bytes)
     }
 
     pfa_info("Adding (paddr=0x%lx) to list of free frames\n", paddr);
-    freeq.push(paddr);
+    q.freeq.push(paddr);
     return true;
   } else {
     pfa_err("Attempted to push to full free queue\n");
     return false;
   }
 }
+
+const uint64_t* pfa_t::batch(pfa_hart_queues_t& q, uint64_t n)
+{
+  const char* first = sim->addr_to_mem(q.batch_addr);
+  reg_t last = q.batch_addr + n * sizeof(uint64_t) - 1;
+  if(q.batch_addr % 8 != 0 || !first ||
+     sim->addr_to_mem(last) != first + (last - q.batch_addr)) {
+    pfa_err("Batch of %ld at (paddr=0x%lx) is not all in memory\n", n, q.batch_addr);
+    return NULL;
+  }
+  return (const uint64_t*)first;
+}
+
+bool pfa_t::evict_batch(pfa_hart_queues_t& q, const uint8_t *bytes)
+{
+  uint64_t n;
+  memcpy(&n, bytes, sizeof(reg_t));
+
+  complete_evictions(q);
+  if(n > PFA_EVICT_MAX - evictq.size()) {
+    pfa_err("Batch of %ld evictions does not fit in evict queue\n", n);
+    return false;
+  }
+  if(n == 0)
+    return true;
+
+  const uint64_t* ents = batch(q, n);
+  if(!ents)
+    return false;
+  for(uint64_t i = 0; i < n; i++) {
+    if(sim->addr_to_mem(evict_val_paddr(ents[i])) == NULL) {
+      pfa_err("Invalid paddr for evicted page (paddr=0x%lx)\n", evict_val_paddr(ents[i]));
+      return false;
+    }
+    if((ents[i] >> 36) >= rmem->key_limit()) {
+      pfa_err("Remote memory can't hold evicted page (rpn=0x%lx)\n", ents[i] >> 36);
+      return false;
+    }
+  }
+
+  for(uint64_t i = 0; i < n; i++)
+    evict_page(q, (const uint8_t*)&ents[i]);
+  evict_batches++;
+  return true;
+}
+
+bool pfa_t::free_batch(pfa_hart_queues_t& q, const uint8_t *bytes)
+{
+  uint64_t n;
+  memcpy(&n, bytes, sizeof(reg_t));
+
+  if(n > PFA_FREE_MAX - q.freeq.size()) {
+    pfa_err("Batch of %ld free frames does not fit in free queue\n", n);
+    return false;
+  }
+  if(n == 0)
+    return true;
+
+  const uint64_t* ents = batch(q, n);
+  if(!ents)
+    return false;
+  for(uint64_t i = 0; i < n; i++) {
+    if(!sim->addr_to_mem(ents[i])) {
+      pfa_err("Invalid paddr for free frame: (paddr=0x%lx)\n", ents[i]);
+      return false;
+    }
+  }
+
+  for(uint64_t i = 0; i < n; i++)
+    free_frame(q, (const uint8_t*)&ents[i]);
+  free_batches++;
+  return true;
+}
@@ -1,8 +1,14 @@
 #ifndef PFA_H
 #define PFA_H
+#include <algorithm>
 #include <queue>
+#include <deque>
+#include <unordered_map>
+#include <vector>
 #include "devices.h"
 #include "encoding.h"
+#include "page_store.h"
+#include "stats.h"
 
 // #define pfa_info(M, ...) fprintf(stderr, "SPIKE PFA: " M, ##__VA_ARGS__)
 #define pfa_info(M, ...)
@@ -12,8 +18,15 @@
 /* Register Offsets 
  * PFA_BASE in encoding.h contains the physical address where the device is mapped.
  * The device model is independent of the base address and only sees these
- * offsets (addr in load()/store()). */
-#define PFA_NPORTS 8
+ * offsets (addr in load()/store()).
+ *
+ * Each hart has its own copy of the ports, PFA_HART_STRIDE bytes apart
+ * (hart n's FREE is at PFA_BASE + n * PFA_HART_STRIDE). The free and new page
+ * queues behind them are per-hart; the evict queue is shared. Only the first
+ * PFA_SIZE / PFA_HART_STRIDE harts have a window; the others can't give the
+ * PFA free frames, so their faults all go to the OS. */
+#define PFA_HART_STRIDE 0x80
+#define PFA_NPORTS 12
 #define PFA_FREEFRAME 0
 #define PFA_FREESTAT  8
 #define PFA_EVICTPAGE 16
@@ -22,7 +35,11 @@
 #define PFA_NEWVADDR  40
 #define PFA_NEWSTAT   48
 #define PFA_DSTMAC    56
-#define PFA_PORT_LAST 56 
+#define PFA_BATCHADDR 64
+#define PFA_EVICTBATCH 72
+#define PFA_FREEBATCH 80
+#define PFA_NEWRING   88
+#define PFA_PORT_LAST 88
 
 /* Human-readable names for MMIO ports. Use PFA_PORT_NAME() to use. */
 extern const char* const _pfa_port_names[];
@@ -32,14 +49,18 @@ extern const char* const _pfa_port_names[];
 /* PFA Sizing */
 #define PFA_FREE_MAX  256
 #define PFA_NEW_MAX   PFA_FREE_MAX
-/* We currently can't model multiple outstanding evictions in spike */
 #define PFA_EVICT_MAX 256
 
+/* How many of the most fetched remote pages the statistics list */
+#define PFA_HOT_PAGES 10
+
 typedef uint64_t pgid_t;
 // How many bits in the PPN component of a page ID (these are in the lsbs) 
 #define PFA_PGID_PPN_BITS 28
 // How many bits in the SW reserved component of a page ID (comes right after ppn)
 #define PFA_PGID_SW_BITS  24
+// Set in a NEW_PGID value when the page was prefetched rather than faulted on
+#define PFA_NEW_PREFETCHED (1ul << 63)
 
 typedef enum pfa_err {
   PFA_OK,      //Success
@@ -49,11 +70,71 @@ typedef enum pfa_err {
   PFA_ERR      //Generic unrecoverable error
 } pfa_err_t;
 
-/* first=vaddr of stored page, second=pointer to 4kb buffer holding page */
-typedef std::map<pgid_t, uint8_t*> rmem_t;
+/* Timing of the link to the memory blade. Evictions and fetches are timed on
+ * the clock of the hart whose port window or fault drives them: its
+ * instructions retired plus the cycles it has stalled on fetches, which it
+ * sits out of the round-robin schedule (see sim_t::step), so the harts'
+ * clocks stay within about a scheduling quantum of each other. All harts
+ * share one evict link and one fetch link, so they may wait on each other.
+ * Everything defaults to 0, which makes evictions and fetches
+ * instantaneous. */
+struct pfa_config_t
+{
+  uint64_t evict_latency = 0;   // from leaving the link to landing remotely
+  uint64_t evict_bandwidth = 0; // bytes per instruction, 0 for unlimited
+  uint64_t fetch_latency = 0;   // from request to the page arriving
+  uint64_t fetch_bandwidth = 0; // bytes per cycle, 0 for unlimited
+
+  /* Remote pages to fetch along with each faulting one, following the
+   * faults' vaddr stride (see pfa_t::prefetch) */
+  uint64_t prefetch = 0;
+
+  /* How the simulator keeps remote pages in host memory (unless they are
+   * in a file, see sim_t::set_remote_mem) */
+  bool zero_pages = false;      // all-zero pages as a flag, without data
+  bool compress = false;        // LZ-compress pages
+
+  /* Track every remote page for the evict_to_fetch and refetches
+   * statistics, at a cost in host memory per page */
+  bool page_stats = false;
+
+  /* Parse a comma-separated list of name=value pairs */
+  void parse(const char* spec);
+};
+
+/* A page waiting in the evict queue. The frame is read when the eviction
+ * completes, so the OS must not reuse it before EVICT_STAT says so. */
+typedef struct pfa_evict {
+  reg_t paddr;
+  pgid_t rem_ppn;
+  uint64_t done;  // time at which the page lands in remote memory
+} pfa_evict_t;
+
+/* The queues each hart sees through its own window of ports */
+typedef struct pfa_hart_queues {
+  std::queue<reg_t> freeq;
+  std::queue<pgid_t> new_pgid_q;
+  std::queue<reg_t>  new_vaddr_q;
+
+  /* Cycles the hart has stalled on fetches, and the part of them it has
+   * yet to sit out (see pfa_t::take_idle) */
+  uint64_t stalled = 0;
+  uint64_t idle = 0;
+  /* Stride detector for prefetching, in pages */
+  reg_t last_fault_vpn = 0;
+  int64_t last_delta = 0;
+  int64_t stride = 1;
+  reg_t next_vpn = 0;   // where the current stream faults after a prefetch
+
+  /* Batched submission (see the spec's Descriptor Rings) */
+  reg_t batch_addr = 0;       // paddr of the array EVICT_BATCH/FREE_BATCH read
+  uint64_t* new_ring = NULL;  // host address of the new page ring, if any
+  uint64_t new_ring_size = 0; // records in the ring, a power of two
+} pfa_hart_queues_t;
 
 /* Forward declare sim_t to avoid circular dep with sim.h */
 class sim_t;
+class processor_t;
 
 /* Generic public PFA helper functions */
 
@@ -76,9 +157,7 @@ reg_t pfa_mk_local_pte(reg_t rem_pte, uintptr_t paddr);
 /* Page-Fault accelerator device */
 class pfa_t : public abstract_device_t {
   public:
-    pfa_t(sim_t *host_sim) {
-      sim = host_sim;
-    }
+    pfa_t(sim_t *host_sim);
 
     /* These are the standard load/store functions from abstract_device_t 
      * They get called when a registered address is loaded/stored */
@@ -88,18 +167,66 @@ class pfa_t : public abstract_device_t {
     /* Retrieve the remote page corresponding to vaddr.
      *  vaddr - vaddr of remote page
      *  host_pte - direct pointer to pte in host memory
+     *  proc - faulting hart, whose queues are used and which is charged
+     *         for the fetch (NULL for hart 0's queues and no charge)
+     *  leaf - host_pte is in a last-level page table, so the ptes around it
+     *         map the neighbouring 4 KiB pages and may be prefetched
      */
-    pfa_err_t fetch_page(reg_t vaddr, reg_t* host_pte);
+    pfa_err_t fetch_page(reg_t vaddr, reg_t* host_pte, processor_t* proc,
+                         bool leaf);
+
+    void set_config(const pfa_config_t& c);
+
+    /* Keep remote pages in store, which outlives the PFA, from now on */
+    void set_remote_store(remote_store_t* store) { rmem = store; }
+
+    /* Write every eviction still in the evict queue to remote memory, as if
+     * the link had finished them. Called when the simulation ends, so that
+     * a store kept across runs has every page the OS evicted. */
+    void flush_evictions();
+
+    /* True if a prefetched page may not have arrived yet */
+    bool pages_arriving() { return !arriving.empty(); }
+
+    /* Stall proc until the page whose local pte is at host_pte arrives, if
+     * it was prefetched and is still on its way. The MMU calls this when a
+     * walk reaches a valid leaf pte. */
+    void wait_for_page(reg_t* host_pte, processor_t* proc);
+
+    /* Take up to max of the cycles hart must still sit out for fetches.
+     * sim_t runs the hart for that many fewer instructions. */
+    size_t take_idle(size_t hart, size_t max)
+    {
+      size_t n = std::min<uint64_t>(queues[hart].idle, max);
+      queues[hart].idle -= n;
+      return n;
+    }
+
+    /* Write queue occupancy, fetch/eviction counts and fault statistics */
+    void dump_stats(stats_writer_t& w);
 
   private:
     /* Pop the most recent new page into bytes.
      * If there is a new page: returns vaddr of new page (FIFO order)
      * If there are no new pages: returns 0*/
-    bool pop_newpgid(uint8_t *bytes);
-    bool pop_newvaddr(uint8_t *bytes);
+    bool pop_newpgid(pfa_hart_queues_t& q, uint8_t *bytes);
+    bool pop_newvaddr(pfa_hart_queues_t& q, uint8_t *bytes);
 
     /* Report how many new pages are currently waiting to be processed */
-    bool check_newpage(uint8_t *bytes);
+    bool check_newpage(pfa_hart_queues_t& q, uint8_t *bytes);
+
+    /* New pages q's hart has not yet taken from its new page queues or
+     * ring, and whether there is room for no more */
+    uint64_t new_waiting(pfa_hart_queues_t& q);
+    bool new_full(pfa_hart_queues_t& q);
+
+    /* Report a fetched page in q's new page ring, or its queues if it has
+     * no ring. There must be room (see new_full). */
+    void push_new(pfa_hart_queues_t& q, pgid_t pgid, reg_t vaddr);
+
+    /* Use the ring whose paddr is in bytes for q's new pages from now on,
+     * or go back to the queues if it is 0 */
+    bool set_new_ring(pfa_hart_queues_t& q, const uint8_t *bytes);
 
     /* Check if there is room in the evict queue. This is an MMIO store
      * response.
@@ -108,7 +235,7 @@ class pfa_t : public abstract_device_t {
      * Return:
      *  True on success, false on failure
      */
-    bool evict_check_size(uint8_t *bytes);
+    bool evict_check_size(pfa_hart_queues_t& q, uint8_t *bytes);
 
     /* Evict a page. Acts as a state-machine:
      * 1st call: Stores "bytes" as vaddr 
@@ -116,7 +243,7 @@ class pfa_t : public abstract_device_t {
      *           (then resets to initial state)
      * Returns: True on legal operation, False on illegal operation
      */
-    bool evict_page(const uint8_t *bytes);
+    bool evict_page(pfa_hart_queues_t& q, const uint8_t *bytes);
 
     /* Check if there is room in the free queue. This is an MMIO store
      * response.
@@ -125,21 +252,114 @@ class pfa_t : public abstract_device_t {
      * Return:
      *  True on success, false on failure
      */
-    bool free_check_size(uint8_t *bytes);
+    bool free_check_size(pfa_hart_queues_t& q, uint8_t *bytes);
 
     /* Enqueu a free frame to be used on the next page fault 
      * bytes: paddr of frame. */
-    bool free_frame(const uint8_t *bytes);
+    bool free_frame(pfa_hart_queues_t& q, const uint8_t *bytes);
+
+    /* The n words at q's batch address, or NULL if they are not all in
+     * memory */
+    const uint64_t* batch(pfa_hart_queues_t& q, uint64_t n);
+
+    /* Evict, or enqueue as free frames, the n entries (count in bytes) at
+     * q's batch address, formatted as for EVICT or FREE. Nothing is done
+     * unless there is room for all of them and all are valid. */
+    bool evict_batch(pfa_hart_queues_t& q, const uint8_t *bytes);
+    bool free_batch(pfa_hart_queues_t& q, const uint8_t *bytes);
+
+    /* The queues behind the port window containing addr, or NULL if there
+     * is no such hart. addr is reduced to the offset within the window. */
+    pfa_hart_queues_t* hart_queues(reg_t& addr);
+
+    /* The links' clock as seen by q's hart (see pfa_config_t) */
+    uint64_t hart_time(pfa_hart_queues_t& q);
+    /* Make hart_time(q) exact for an access about to be served, which must
+     * not have had any effect yet (see processor_t::sync_instret) */
+    void sync_time(pfa_hart_queues_t& q);
+
+    /* Write every eviction whose time has come, by q's hart's clock, to
+     * remote memory */
+    void complete_evictions(pfa_hart_queues_t& q);
+    /* Write the oldest eviction to remote memory and drop it from the
+     * queue */
+    void finish_eviction();
+
+    /* True if an eviction to rem_ppn is still in the evict queue */
+    bool eviction_pending(pgid_t rem_ppn);
+
+    /* Move the remote page named by rem_pte into one of q's free frames,
+     * make the pte at host_pte local and report the page in q's new page
+     * queues. */
+    void install_page(pfa_hart_queues_t& q, reg_t vaddr, reg_t* host_pte,
+                      reg_t rem_pte, bool prefetched);
+
+    /* Fetch up to config.prefetch more remote pages along the stream of
+     * faults on q's hart, after a fault on vaddr, whose pte is at host_pte */
+    void prefetch(pfa_hart_queues_t& q, reg_t vaddr, reg_t* host_pte,
+                  processor_t* proc);
+
+    /* Queue one page on the fetch link no earlier than t, returning when it
+     * starts to cross */
+    uint64_t reserve_fetch_link(uint64_t t);
+
+    /* The queues of proc's hart */
+    pfa_hart_queues_t& proc_queues(processor_t* proc);
+
+    /* Stall proc, whose queues are q, for the time a page takes to arrive */
+    void charge_fetch(pfa_hart_queues_t& q, processor_t* proc);
 
     sim_t *sim;
 
-    std::queue<reg_t> freeq;
-    std::queue<pgid_t> new_pgid_q;
-    std::queue<reg_t>  new_vaddr_q;
-    rmem_t rmem;
+    std::vector<pfa_hart_queues_t> queues; // indexed like sim_t::procs
+    /* Evicted pages keyed by remote ppn, in local_store unless another
+     * store was given. A page leaves remote memory once it is fetched (see
+     * the spec's PTE remote ppn field). */
+    page_store_t local_store;
+    remote_store_t* rmem;
+
+    uint64_t fetches = 0;
+    uint64_t prefetches = 0;
+    uint64_t prefetch_waits = 0;       // touches of a page still arriving
+    uint64_t prefetch_wait_stalls = 0; // and the cycles they stalled for
+    uint64_t evictions = 0;
+    uint64_t lost_evictions = 0; // that remote memory failed to store
+
+    /* MMIO accesses, and how many of them submitted batches */
+    uint64_t mmio_loads = 0;
+    uint64_t mmio_stores = 0;
+    uint64_t evict_batches = 0;
+    uint64_t free_batches = 0;
+
+    /* Faults and how the ones the PFA couldn't serve fell back to the OS */
+    uint64_t faults = 0;
+    uint64_t no_free = 0;
+    uint64_t no_new = 0;
+    uint64_t no_page = 0;
+    /* The faulting hart's queue occupancy at each fault */
+    stats_histogram_t free_at_fault;
+    stats_histogram_t new_at_fault;
+    /* The most fetched remote pages, to spot thrashing */
+    stats_top_t hot_pages;
+    /* With config.page_stats only, since they keep an entry per remote page:
+     * time (see hart_time) from a page's eviction to fetching it back, and how
+     * often each page was fetched */
+    std::unordered_map<pgid_t, uint64_t> evicted_at;
+    stats_histogram_t evict_to_fetch;
+    std::unordered_map<pgid_t, uint64_t> page_fetches;
+    uint64_t refetches = 0;   // fetches of a page that was fetched before
+
+    pfa_config_t config;
+    std::deque<pfa_evict_t> evictq;
+    uint64_t evict_link_free = 0; // when the link can start the next page
 
-    /* This enforces polling for completion in the evict queue */
-    bool eviction_in_progress = false;
-    pgid_t eviction_rem_ppn;
+    uint64_t fetch_link_free = 0; // in hart_time, like evict_link_free
+    /* When each prefetched page still on the link arrives, by its pte. A
+     * page leaves once touched, and the rest when the map grows (see
+     * prefetch). */
+    std::unordered_map<reg_t*, uint64_t> arriving;
+    uint64_t fetch_stalls = 0;    // total cycles harts waited for fetches
+    uint64_t fetch_queueing = 0;  // part of fetch_stalls spent waiting for the link
+    uint64_t max_fetch_stall = 0;
 };
 #endif
@@ -0,0 +1,88 @@
+// See LICENSE for license details.
+
+#include "prefetcher.h"
+#include <cstring>
+
+prefetcher_t* prefetcher_t::construct(const char* name, size_t idx_shift)
+{
+  if (strcmp(name, "nextline") == 0)
+    return new next_line_prefetcher_t(idx_shift);
+  if (strcmp(name, "stride") == 0)
+    return new stride_prefetcher_t(idx_shift);
+  if (strcmp(name, "stream") == 0)
+    return new stream_prefetcher_t(idx_shift);
+  return NULL;
+}
+
+size_t stride_prefetcher_t::access(uint64_t addr, uint64_t pc, bool trigger, uint64_t* out)
+{
+  if (pc == 0)
+    return 0;
+
+  // instructions are at least 2-byte aligned
+  entry_t& e = table[(pc >> 1) % ENTRIES];
+  if (e.pc != pc) {
+    e.pc = pc;
+    e.last = addr;
+    e.stride = 0;
+    e.confidence = 0;
+    return 0;
+  }
+
+  int64_t delta = addr - e.last;
+  e.last = addr;
+  if (delta == e.stride) {
+    if (e.confidence < 3)
+      e.confidence++;
+  } else if (e.confidence > 0) {
+    e.confidence--;
+  } else {
+    e.stride = delta;
+  }
+
+  if (e.confidence < CONFIDENT || e.stride == 0)
+    return 0;
+
+  int64_t linesz = int64_t(1) << idx_shift;
+  int64_t step = e.stride;
+  if (step > -linesz && step < linesz)
+    step = step < 0 ? -linesz : linesz;
+
+  size_t n = 0;
+  for (size_t k = 1; k <= DEGREE; k++)
+    out[n++] = (addr + k * step) >> idx_shift;
+  return n;
+}
+
+size_t stream_prefetcher_t::access(uint64_t addr, uint64_t pc, bool trigger, uint64_t* out)
+{
+  if (!trigger)
+    return 0;
+
+  uint64_t line = addr >> idx_shift;
+  clock++;
+
+  stream_t* lru = &streams[0];
+  for (auto& s : streams) {
+    int64_t d = line - s.last;
+    bool match = s.dir == 0 ? d != 0 && d >= -WINDOW && d <= WINDOW
+                            : d * s.dir > 0 && d * s.dir <= WINDOW;
+    if (match && s.used != 0) {
+      if (s.dir == 0)
+        s.dir = d > 0 ? 1 : -1;
+      s.last = line;
+      s.used = clock;
+      for (size_t k = 1; k <= MAX_DEGREE; k++)
+        out[k-1] = line + k * s.dir;
+      return MAX_DEGREE;
+    }
+    if (s.used < lru->used)
+      lru = &s;
+  }
+
+  // start training a new stream
+  lru->last = line;
+  lru->dir = 0;
+  lru->used = clock;
+  return 0;
+}
@@ -0,0 +1,99 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_PREFETCHER_H
+#define _RISCV_PREFETCHER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Decides which lines a cache should prefetch.  The cache reports every
+// demand access; the prefetcher answers with the line addresses (byte
+// address >> line shift) it would like fetched.  The cache drops requests
+// for lines it already holds or has in flight.
+class prefetcher_t
+{
+ public:
+  static const size_t MAX_DEGREE = 4;
+
+  prefetcher_t(size_t idx_shift) : idx_shift(idx_shift) {}
+  virtual ~prefetcher_t() {}
+  // addr was accessed by the instruction at pc (0 if unknown).  trigger is
+  // set on a miss and on the first hit to a prefetched line.  Writes up to
+  // MAX_DEGREE lines to out and returns how many.
+  virtual size_t access(uint64_t addr, uint64_t pc, bool trigger, uint64_t* out) = 0;
+  virtual prefetcher_t* clone() const = 0;
+
+  // name is one of nextline, stride, or stream.  Returns NULL for an
+  // unknown name.
+  static prefetcher_t* construct(const char* name, size_t idx_shift);
+
+ protected:
+  size_t idx_shift;
+};
+
+// Tagged next-line prefetching: a miss or a first hit on a prefetched line
+// fetches the following line.
+class next_line_prefetcher_t : public prefetcher_t
+{
+ public:
+  next_line_prefetcher_t(size_t idx_shift) : prefetcher_t(idx_shift) {}
+  size_t access(uint64_t addr, uint64_t pc, bool trigger, uint64_t* out)
+  {
+    if (!trigger)
+      return 0;
+    out[0] = (addr >> idx_shift) + 1;
+    return 1;
+  }
+  prefetcher_t* clone() const { return new next_line_prefetcher_t(*this); }
+};
+
+// Reference prediction table (Chen and Baer, 1995): a direct-mapped table
+// indexed by PC remembers each load or store's last address and stride,
+// and prefetches ahead once the same stride has been seen twice running.
+// Strides shorter than a line prefetch the adjacent line instead.
+class stride_prefetcher_t : public prefetcher_t
+{
+ public:
+  stride_prefetcher_t(size_t idx_shift) : prefetcher_t(idx_shift), table(ENTRIES) {}
+  size_t access(uint64_t addr, uint64_t pc, bool trigger, uint64_t* out);
+  prefetcher_t* clone() const { return new stride_prefetcher_t(*this); }
+ private:
+  static const size_t ENTRIES = 256;
+  static const size_t DEGREE = 2;
+  static const uint8_t CONFIDENT = 2;
+
+  struct entry_t
+  {
+    uint64_t pc;
+    uint64_t last;
+    int64_t stride;
+    uint8_t confidence; // 0-3
+  };
+  std::vector<entry_t> table;
+};
+
+// Sequential stream buffer: misses allocate a stream, and a later miss
+// (or first hit on a prefetched line) a few lines above or below it fixes
+// the stream's direction and runs the prefetches MAX_DEGREE lines ahead.
+class stream_prefetcher_t : public prefetcher_t
+{
+ public:
+  stream_prefetcher_t(size_t idx_shift) : prefetcher_t(idx_shift), streams(STREAMS), clock(0) {}
+  size_t access(uint64_t addr, uint64_t pc, bool trigger, uint64_t* out);
+  prefetcher_t* clone() const { return new stream_prefetcher_t(*this); }
+ private:
+  static const size_t STREAMS = 16;
+  static const int64_t WINDOW = 4; // lines from a stream's head that match it
+
+  struct stream_t
+  {
+    uint64_t last;   // most recent line
+    int64_t dir;     // +1, -1, or 0 while training
+    uint64_t used;   // clock of the last match, for replacement
+  };
+  std::vector<stream_t> streams;
+  uint64_t clock;
+};
+
+#endif
@@ -7,6 +7,12 @@
 #include "sim.h"
 #include "mmu.h"
 #include "disasm.h"
+#include "bbv.h"
+#include "callgraph.h"
+#include "commit_log.h"
+#include "symtab.h"
+#include "timing.h"
+#include "stats.h"
 #include <cinttypes>
 #include <cmath>
 #include <cstdlib>
@@ -22,7 +28,7 @@
 processor_t::processor_t(const char* isa, simif_t* sim, uint32_t id,
         bool halt_on_reset)
   : debug(false), halt_request(false), sim(sim), ext(NULL), id(id),
-  halt_on_reset(halt_on_reset), last_pc(1), executions(1)
+  histogram_enabled(false), bbv(NULL), callgraph(NULL), commit_log(NULL), timing(NULL), traps(0), interrupts(0), halt_on_reset(halt_on_reset), instret_synced(true), last_pc(1), executions(1)
 {
   parse_isa_string(isa);
   register_base_instructions();
@@ -35,15 +41,12 @@ processor_t::processor_t(const char* isa, simif_t* sim, uint32_t id,
 
 processor_t::~processor_t()
 {
-#ifdef RISCV_ENABLE_HISTOGRAM
-  if (histogram_enabled)
-  {
-    fprintf(stderr, "PC Histogram size:%zu\n", pc_histogram.size());
-    for (auto it : pc_histogram)
-      fprintf(stderr, "%0" PRIx64 " %" PRIu64 "\n", it.first, it.second);
-  }
-#endif
-
+  delete bbv;
+  delete callgraph;
+  delete commit_log;
+  if (timing)
+    timing->print_stats(("Hart" + std::to_string(id)).c_str(), state.minstret);
+  delete timing;
   delete mmu;
   delete disassembler;
 }
@@ -145,6 +148,96 @@ void processor_t::set_histogram(bool value)
 #endif
 }
 
+void processor_t::print_histogram(const symtab_t& symtab, const char* prefix)
+{
+#ifdef RISCV_ENABLE_HISTOGRAM
+  if (!histogram_enabled)
+    return;
+
+  if (!prefix) {
+    fprintf(stderr, "core %3d: PC histogram\n", id);
+    pc_histogram.write_profile(stderr, symtab);
+    return;
+  }
+
+  std::string base = std::string(prefix) + "." + std::to_string(id);
+  FILE* func = fopen((base + ".func").c_str(), "w");
+  FILE* pcs = fopen((base + ".pc").c_str(), "w");
+  if (!func || !pcs) {
+    fprintf(stderr, "Unable to write PC histogram to %s.{func,pc}\n", base.c_str());
+  } else {
+    pc_histogram.write_profile(func, symtab);
+    pc_histogram.write_pcs(pcs, symtab);
+  }
+  if (func) fclose(func);
+  if (pcs) fclose(pcs);
+#endif
+}
+
+void processor_t::set_bbv(const std::string& path, uint64_t interval)
+{
+#ifdef RISCV_ENABLE_HISTOGRAM
+  delete bbv;
+  bbv = new bbv_t(path, interval);
+#else
+  fprintf(stderr, "Basic-block vector support has not been properly enabled;");
+  fprintf(stderr, " please re-build the riscv-isa-run project using \"configure --enable-histogram\".\n");
+#endif
+}
+
+void processor_t::set_callgraph(bool value)
+{
+#ifdef RISCV_ENABLE_HISTOGRAM
+  delete callgraph;
+  callgraph = value ? new callgraph_t : NULL;
+#else
+  if (value) {
+    fprintf(stderr, "Call graph support has not been properly enabled;");
+    fprintf(stderr, " please re-build the riscv-isa-run project using \"configure --enable-histogram\".\n");
+  }
+#endif
+}
+
+void processor_t::print_callgraph(const symtab_t& symtab, const char* prefix)
+{
+  if (callgraph)
+    callgraph->write_folded(prefix, id, symtab);
+}
+
+void processor_t::set_commit_log(commit_log_writer_t* writer)
+{
+#ifdef RISCV_ENABLE_COMMITLOG
+  delete commit_log;
+  commit_log = writer ? new commit_log_stream_t(writer, id) : NULL;
+#else
+  if (writer) {
+    fprintf(stderr, "Commit logging support has not been properly enabled;");
+    fprintf(stderr, " please re-build the riscv-isa-run project using \"configure --enable-commitlog\".\n");
+  }
+#endif
+}
+
+void processor_t::set_timing(const timing_config_t& config)
+{
+  delete timing;
+  timing = new timing_model_t(config);
+}
+
+reg_t processor_t::get_cycles()
+{
+  return timing ? state.minstret + timing->stalls() : state.minstret;
+}
+
+void processor_t::dump_stats(stats_writer_t& w)
+{
+  w.add("instret", uint64_t(state.minstret));
+  w.add("cycles", uint64_t(get_cycles()));
+  w.add("traps", traps);
+  w.add("interrupts", interrupts);
+  if (timing)
+    timing->dump_stats(w);
+}
+
 void processor_t::reset()
 {
   state.reset(max_isa);
@@ -271,6 +364,7 @@ void processor_t::take_trap(trap_t& t, reg_t epc)
   bool interrupt = (bit & ((reg_t)1 << (max_xlen-1))) != 0;
   if (interrupt)
     deleg = state.mideleg, bit &= ~((reg_t)1 << (max_xlen-1));
+  interrupt ? interrupts++ : traps++;
   if (state.prv <= PRV_S && bit < max_xlen && ((deleg >> bit) & 1)) {
     // handle the trap in S-mode
     state.pc = state.stvec;
@@ -402,15 +496,29 @@ void processor_t::set_csr(int which, reg_t val)
     }
     case CSR_MINSTRET:
     case CSR_MCYCLE:
-      if (xlen == 32)
-        state.minstret = (state.minstret >> 32 << 32) | (val & 0xffffffffU);
-      else
-        state.minstret = val;
-      break;
     case CSR_MINSTRETH:
-    case CSR_MCYCLEH:
-      state.minstret = (val << 32) | (state.minstret << 32 >> 32);
+    case CSR_MCYCLEH: {
+      // without a timing model, mcycle is minstret
+      bool cycle = timing && (which == CSR_MCYCLE || which == CSR_MCYCLEH);
+      reg_t cycles = get_cycles();
+      reg_t old = cycle ? cycles : state.minstret;
+      reg_t now;
+      if (which == CSR_MINSTRETH || which == CSR_MCYCLEH)
+        now = (val << 32) | (old << 32 >> 32);
+      else if (xlen == 32)
+        now = (old >> 32 << 32) | (val & 0xffffffffU);
+      else
+        now = val;
+
+      if (cycle) {
+        timing->set_stalls(now - state.minstret);
+      } else {
+        state.minstret = now;
+        if (timing)
+          timing->set_stalls(cycles - now);
+      }
       break;
+    }
     case CSR_SCOUNTEREN:
       state.scounteren = val;
       break;
@@ -566,23 +674,33 @@ reg_t processor_t::get_csr(int which)
         break;
       return (state.fflags << FSR_AEXC_SHIFT) | (state.frm << FSR_RD_SHIFT);
     case CSR_INSTRET:
-    case CSR_CYCLE:
       if (ctr_ok)
         return state.minstret;
       break;
+    case CSR_CYCLE:
+      if (ctr_ok)
+        return get_cycles();
+      break;
     case CSR_MINSTRET:
-    case CSR_MCYCLE:
       return state.minstret;
+    case CSR_MCYCLE:
+      return get_cycles();
     case CSR_INSTRETH:
-    case CSR_CYCLEH:
       if (ctr_ok && xlen == 32)
         return state.minstret >> 32;
       break;
+    case CSR_CYCLEH:
+      if (ctr_ok && xlen == 32)
+        return get_cycles() >> 32;
+      break;
     case CSR_MINSTRETH:
-    case CSR_MCYCLEH:
       if (xlen == 32)
         return state.minstret >> 32;
       break;
+    case CSR_MCYCLEH:
+      if (xlen == 32)
+        return get_cycles() >> 32;
+      break;
     case CSR_SCOUNTEREN: return state.scounteren;
     case CSR_MCOUNTEREN: return state.mcounteren;
     case CSR_SSTATUS: {
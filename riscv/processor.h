@@ -6,6 +6,7 @@
 #include "config.h"
 #include "devices.h"
 #include "trap.h"
+#include "histogram.h"
 #include <string>
 #include <vector>
 #include <map>
@@ -18,6 +19,17 @@ class simif_t;
 class trap_t;
 class extension_t;
 class disassembler_t;
+class bbv_t;
+class callgraph_t;
+class commit_log_writer_t;
+class commit_log_stream_t;
+class symtab_t;
+class timing_model_t;
+struct timing_config_t;
+class stats_writer_t;
+
+// Thrown by processor_t::sync_instret and caught by processor_t::step().
+struct instret_sync_t {};
 
 struct insn_desc_t
 {
@@ -169,6 +181,31 @@ public:
 
   void set_debug(bool value);
   void set_histogram(bool value);
+  // Write the PC histogram: a function profile to stderr, or to
+  // <prefix>.<hartid>.func plus per-PC counts in <prefix>.<hartid>.pc.
+  void print_histogram(const symtab_t& symtab, const char* prefix);
+  void set_bbv(const std::string& path, uint64_t interval);
+  void set_callgraph(bool value);
+  // Write collapsed call stacks to <prefix>.<hartid>.<prv>.folded.
+  void print_callgraph(const symtab_t& symtab, const char* prefix);
+  // Send the commit log to a binary log instead of stderr.
+  void set_commit_log(commit_log_writer_t* writer);
+  commit_log_stream_t* get_commit_log() { return commit_log; }
+  // Estimate mcycle with a timing model instead of copying minstret.
+  void set_timing(const timing_config_t& config);
+  timing_model_t* get_timing() { return timing; }
+  reg_t get_cycles();
+  // step() counts retired instructions locally and only adds them to
+  // minstret from time to time.  Devices that time the hart's accesses by
+  // minstret call this first, before the access has any effect: if it is
+  // behind, it throws, and step() brings it up to date and runs the
+  // instruction making the access again.
+  void sync_instret()
+  {
+    if (unlikely(!instret_synced))
+      throw instret_sync_t();
+  }
+  void dump_stats(stats_writer_t& w);
   void reset();
   void step(size_t n); // run for n cycles
   void set_csr(int which, reg_t val);
@@ -198,7 +235,8 @@ public:
   reg_t legalize_privilege(reg_t);
   void set_privilege(reg_t);
   void yield_load_reservation() { state.load_reservation = (reg_t)-1; }
-  void update_histogram(reg_t pc);
+  void update_histogram(reg_t pc, reg_t npc, insn_t insn);
+  void update_timing(reg_t pc, reg_t npc, insn_t insn);
   const disassembler_t* get_disassembler() { return disassembler; }
 
   void register_insn(insn_desc_t);
@@ -309,10 +347,17 @@ private:
   reg_t max_isa;
   std::string isa_string;
   bool histogram_enabled;
+  bbv_t* bbv; // SimPoint basic-block vectors, NULL unless --bbv was given
+  callgraph_t* callgraph; // guest call stacks, NULL unless --callgraph was given
+  commit_log_stream_t* commit_log; // binary commit log, NULL for text on stderr
+  timing_model_t* timing; // cycle estimates, NULL unless --timing was given
+  uint64_t traps;      // exceptions taken, not counting debug-mode entries
+  uint64_t interrupts;
   bool halt_on_reset;
+  bool instret_synced; // minstret counts every instruction retired so far
 
   std::vector<insn_desc_t> instructions;
-  std::map<reg_t,uint64_t> pc_histogram;
+  pc_histogram_t pc_histogram;
 
   static const size_t OPCODE_CACHE_SIZE = 8191;
   insn_desc_t opcode_cache[OPCODE_CACHE_SIZE];
@@ -0,0 +1,37 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_REMOTE_STORE_H
+#define _RISCV_REMOTE_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+
+class stats_writer_t;
+
+// Where a remote memory model (the PFA or the memory blade) keeps the 4 KiB
+// pages it holds, keyed by remote page number.
+class remote_store_t
+{
+ public:
+  static const size_t PAGE_SIZE = 4096;
+
+  virtual ~remote_store_t() {}
+
+  // Store a copy of page under key, replacing any page already there.
+  // Returns false, storing nothing, if the store can't hold key.
+  virtual bool write(uint64_t key, const uint8_t* page) = 0;
+  // Copy the page stored under key into page.  Returns false if there is
+  // none.
+  virtual bool read(uint64_t key, uint8_t* page) = 0;
+  virtual bool contains(uint64_t key) = 0;
+  // Drop the page stored under key.
+  virtual bool erase(uint64_t key) = 0;
+
+  // Keys from this one up can never be written.
+  virtual uint64_t key_limit() const { return UINT64_MAX; }
+
+  virtual size_t size() const = 0;
+  virtual void dump_stats(stats_writer_t& w) = 0;
+};
+
+#endif
@@ -0,0 +1,96 @@
+// See LICENSE for license details.
+
+#include "replacement.h"
+#include <cstring>
+
+replacement_policy_t* replacement_policy_t::construct(const char* name, size_t sets, size_t ways)
+{
+  if (strcmp(name, "random") == 0)
+    return new random_policy_t(ways);
+  if (strcmp(name, "lru") == 0 && ways <= 256)
+    return new lru_policy_t(sets, ways);
+  if (strcmp(name, "plru") == 0 && ways <= 64 && (ways & (ways-1)) == 0)
+    return new plru_policy_t(sets, ways);
+  if (strcmp(name, "srrip") == 0)
+    return new srrip_policy_t(sets, ways);
+  return NULL;
+}
+
+const uint8_t srrip_policy_t::RRPV_MAX;
+
+lru_policy_t::lru_policy_t(size_t sets, size_t ways)
+  : ways(ways), rank(sets * ways)
+{
+  for (size_t i = 0; i < sets * ways; i++)
+    rank[i] = i % ways;
+}
+
+void lru_policy_t::touch(size_t set, size_t way)
+{
+  uint8_t* r = &rank[set * ways];
+  uint8_t old = r[way];
+  // everything more recent than way ages by one
+  for (size_t i = 0; i < ways; i++)
+    r[i] += r[i] < old;
+  r[way] = 0;
+}
+
+size_t lru_policy_t::victim(size_t set)
+{
+  uint8_t* r = &rank[set * ways];
+  size_t way = 0;
+  for (size_t i = 0; i < ways; i++)
+    if (r[i] == ways - 1)
+      way = i;
+  return way;
+}
+
+plru_policy_t::plru_policy_t(size_t sets, size_t ways)
+  : levels(0), tree(sets)
+{
+  while ((size_t(1) << levels) < ways)
+    levels++;
+}
+
+void plru_policy_t::touch(size_t set, size_t way)
+{
+  uint64_t bits = tree[set];
+  size_t node = 1;
+  for (size_t l = levels; l-- > 0; ) {
+    uint64_t dir = (way >> l) & 1;
+    // point this node at the other half
+    bits = (bits & ~(uint64_t(1) << node)) | (dir ^ 1) << node;
+    node = 2*node + dir;
+  }
+  tree[set] = bits;
+}
+
+size_t plru_policy_t::victim(size_t set)
+{
+  uint64_t bits = tree[set];
+  size_t node = 1, way = 0;
+  for (size_t l = 0; l < levels; l++) {
+    size_t dir = (bits >> node) & 1;
+    node = 2*node + dir;
+    way = 2*way + dir;
+  }
+  return way;
+}
+
+size_t srrip_policy_t::victim(size_t set)
+{
+  uint8_t* r = &rrpv[set * ways];
+  uint8_t max = 0;
+  for (size_t i = 0; i < ways; i++)
+    max = r[i] > max ? r[i] : max;
+
+  // age the whole set at once until some line reaches the distant RRPV
+  uint8_t age = RRPV_MAX - max;
+  size_t way = 0;
+  for (size_t i = ways; i-- > 0; ) {
+    r[i] += age;
+    if (r[i] == RRPV_MAX)
+      way = i;
+  }
+  return way;
+}
@@ -0,0 +1,99 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_REPLACEMENT_H
+#define _RISCV_REPLACEMENT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class lfsr_t
+{
+ public:
+  lfsr_t() : reg(1) {}
+  lfsr_t(const lfsr_t& lfsr) : reg(lfsr.reg) {}
+  uint32_t next() { return reg = (reg>>1)^(-(reg&1) & 0xd0000001); }
+ private:
+  uint32_t reg;
+};
+
+// Chooses which way of a set to evict.  The cache reports every hit and
+// every fill; the policy keeps whatever per-set state it needs.
+class replacement_policy_t
+{
+ public:
+  virtual ~replacement_policy_t() {}
+  virtual void hit(size_t set, size_t way) = 0;
+  virtual void fill(size_t set, size_t way) = 0;
+  virtual size_t victim(size_t set) = 0;
+  virtual replacement_policy_t* clone() const = 0;
+
+  // name is one of random, lru, plru, or srrip.  Returns NULL for an
+  // unknown name or a geometry the policy cannot support.
+  static replacement_policy_t* construct(const char* name, size_t sets, size_t ways);
+};
+
+class random_policy_t : public replacement_policy_t
+{
+ public:
+  random_policy_t(size_t ways) : ways(ways) {}
+  void hit(size_t set, size_t way) {}
+  void fill(size_t set, size_t way) {}
+  size_t victim(size_t set) { return lfsr.next() % ways; }
+  replacement_policy_t* clone() const { return new random_policy_t(*this); }
+ private:
+  size_t ways;
+  lfsr_t lfsr;
+};
+
+// True LRU.  Each way holds its recency rank, 0 being the most recently
+// used, so a set costs one byte per way.
+class lru_policy_t : public replacement_policy_t
+{
+ public:
+  lru_policy_t(size_t sets, size_t ways);
+  void hit(size_t set, size_t way) { touch(set, way); }
+  void fill(size_t set, size_t way) { touch(set, way); }
+  size_t victim(size_t set);
+  replacement_policy_t* clone() const { return new lru_policy_t(*this); }
+ private:
+  size_t ways;
+  std::vector<uint8_t> rank;
+  void touch(size_t set, size_t way);
+};
+
+// Tree pseudo-LRU: ways-1 bits per set, each pointing to the less recently
+// used half of its subtree.  Requires a power-of-two number of ways.
+class plru_policy_t : public replacement_policy_t
+{
+ public:
+  plru_policy_t(size_t sets, size_t ways);
+  void hit(size_t set, size_t way) { touch(set, way); }
+  void fill(size_t set, size_t way) { touch(set, way); }
+  size_t victim(size_t set);
+  replacement_policy_t* clone() const { return new plru_policy_t(*this); }
+ private:
+  size_t levels;
+  std::vector<uint64_t> tree; // heap-ordered node bits, root at bit 1
+  void touch(size_t set, size_t way);
+};
+
+// Static re-reference interval prediction (Jaleel et al., ISCA 2010) with
+// 2-bit RRPVs: lines are inserted with a long re-reference prediction and
+// promoted on a hit, which keeps scans from flushing the working set.
+class srrip_policy_t : public replacement_policy_t
+{
+ public:
+  srrip_policy_t(size_t sets, size_t ways)
+    : ways(ways), rrpv(sets * ways, RRPV_MAX) {}
+  void hit(size_t set, size_t way) { rrpv[set*ways + way] = 0; }
+  void fill(size_t set, size_t way) { rrpv[set*ways + way] = RRPV_MAX - 1; }
+  size_t victim(size_t set);
+  replacement_policy_t* clone() const { return new srrip_policy_t(*this); }
+ private:
+  static const uint8_t RRPV_MAX = 3;
+  size_t ways;
+  std::vector<uint8_t> rrpv;
+};
+
+#endif
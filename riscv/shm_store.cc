@@ -0,0 +1,120 @@
+// See LICENSE for license details.
+
+#include "shm_store.h"
+#include "memblade_shm.h"
+#include "stats.h"
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+shm_store_t::shm_store_t(const char* name)
+  : name(name), chan(NULL), pages(0), requests(0), wait_ns(0)
+{
+  int fd = shm_open(name, O_RDWR, 0);
+  if (fd < 0) {
+    fprintf(stderr, "memblade server: can't open %s (is spike-memblade-server running?): %s\n",
+            name, strerror(errno));
+    exit(1);
+  }
+  void* p = mmap(NULL, sizeof(mbshm_region_t), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "memblade server: can't map %s: %s\n", name, strerror(errno));
+    exit(1);
+  }
+  region = (mbshm_region_t*)p;
+  if (region->magic.load(std::memory_order_acquire) != MBSHM_MAGIC) {
+    fprintf(stderr, "memblade server: %s is not a memory blade\n", name);
+    exit(1);
+  }
+
+  for (size_t i = 0; i < MBSHM_CLIENTS && !chan; i++) {
+    uint32_t state = MBSHM_FREE;
+    if (region->channels[i].state.compare_exchange_strong(state, MBSHM_CLAIMED))
+      chan = &region->channels[i];
+  }
+  if (!chan) {
+    fprintf(stderr, "memblade server: all %d channels of %s are in use\n",
+            MBSHM_CLIENTS, name);
+    exit(1);
+  }
+
+  chan->pid = getpid();
+  chan->req.head.store(0, std::memory_order_relaxed);
+  chan->req.tail.store(0, std::memory_order_relaxed);
+  chan->resp.head.store(0, std::memory_order_relaxed);
+  chan->resp.tail.store(0, std::memory_order_relaxed);
+  chan->state.store(MBSHM_ACTIVE, std::memory_order_release);
+
+  // learn how many pages the blade already holds
+  contains(0);
+}
+
+shm_store_t::~shm_store_t()
+{
+  chan->state.store(MBSHM_FREE, std::memory_order_release);
+  munmap(region, sizeof(mbshm_region_t));
+}
+
+bool shm_store_t::call(int op, uint64_t key, uint8_t* page, bool in, bool out)
+{
+  uint32_t buf = chan->req.head.load(std::memory_order_relaxed) % MBSHM_RING;
+  if (in)
+    memcpy(chan->pages[buf], page, MBSHM_PAGE);
+
+  mbshm_desc_t d = {key, 0, uint32_t(op), buf, 0, 0};
+  auto start = std::chrono::steady_clock::now();
+  // at most one request is outstanding, so the ring always has room
+  mbshm_push(chan->req, d);
+  for (uint64_t spins = 1; !mbshm_pop(chan->resp, d); spins++) {
+    sched_yield();
+    if (spins % 100000 == 0 && kill(region->pid, 0) < 0 && errno == ESRCH) {
+      fprintf(stderr, "memblade server: %s has gone away\n", name.c_str());
+      exit(1);
+    }
+  }
+  wait_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start).count();
+  requests++;
+
+  if (out && d.ok)
+    memcpy(page, chan->pages[d.buf], MBSHM_PAGE);
+  pages = d.pages;
+  return d.ok;
+}
+
+bool shm_store_t::write(uint64_t key, const uint8_t* page)
+{
+  return call(MBSHM_WRITE, key, (uint8_t*)page, true, false);
+}
+
+bool shm_store_t::read(uint64_t key, uint8_t* page)
+{
+  return call(MBSHM_READ, key, page, false, true);
+}
+
+bool shm_store_t::contains(uint64_t key)
+{
+  return call(MBSHM_CONTAINS, key, NULL, false, false);
+}
+
+bool shm_store_t::erase(uint64_t key)
+{
+  return call(MBSHM_ERASE, key, NULL, false, false);
+}
+
+void shm_store_t::dump_stats(stats_writer_t& w)
+{
+  w.add("server", name);
+  w.add("pages", uint64_t(pages));
+  w.add("requests", requests);
+  w.add("wait_ns", wait_ns);
+}
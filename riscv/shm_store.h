@@ -0,0 +1,48 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_SHM_STORE_H
+#define _RISCV_SHM_STORE_H
+
+#include "remote_store.h"
+#include <string>
+
+struct mbshm_region;
+struct mbshm_channel;
+
+// Remote pages kept by a spike-memblade-server process, reached through a
+// channel of its shared memory object (see memblade_shm.h).  Every request
+// waits for the server's answer, so the store behaves like a local one.
+class shm_store_t : public remote_store_t
+{
+ public:
+  // Connect to the server that created the shared memory object name.
+  // Exits if there is none or all its channels are in use.
+  shm_store_t(const char* name);
+  ~shm_store_t();
+
+  bool write(uint64_t key, const uint8_t* page);
+  bool read(uint64_t key, uint8_t* page);
+  bool contains(uint64_t key);
+  bool erase(uint64_t key);
+
+  size_t size() const { return pages; }
+  void dump_stats(stats_writer_t& w);
+
+ private:
+  std::string name;
+  struct mbshm_region* region;
+  struct mbshm_channel* chan;
+  size_t pages;         // in the blade, as of the last answer
+
+  uint64_t requests;
+  uint64_t wait_ns;     // host time spent waiting for answers
+
+  // Send one request, copying page to the server if in is set and the
+  // answer back to page if out is set.  Returns the answer's ok field.
+  bool call(int op, uint64_t key, uint8_t* page, bool in, bool out);
+
+  shm_store_t(const shm_store_t&) = delete;
+  shm_store_t& operator=(const shm_store_t&) = delete;
+};
+
+#endif
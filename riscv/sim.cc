@@ -3,6 +3,8 @@
 #include "sim.h"
 #include "mmu.h"
 #include "remote_bitbang.h"
+#include "file_store.h"
+#include "shm_store.h"
 #include <map>
 #include <iostream>
 #include <sstream>
@@ -23,17 +25,26 @@ static void handle_signal(int sig)
   signal(sig, &handle_signal);
 }
 
+static volatile sig_atomic_t stats_requested = 0;
+static void handle_stats_signal(int sig)
+{
+  stats_requested = 1;
+}
+
 sim_t::sim_t(const char* isa, size_t nprocs, bool halted, reg_t start_pc,
              std::vector<std::pair<reg_t, mem_t*>> mems,
              const std::vector<std::string>& args,
              std::vector<int> const hartids, unsigned progsize,
              unsigned max_bus_master_bits, bool require_authentication)
   : htif_t(args), mems(mems), procs(std::max(nprocs, size_t(1))),
-    start_pc(start_pc), current_step(0), current_proc(0), debug(false),
-    remote_bitbang(NULL),
+    start_pc(start_pc), current_step(0), current_proc(0), instret(0),
+    next_phase(0), warmup(0), debug(false), histogram_enabled(false),
+    histogram_prefix(NULL), callgraph_prefix(NULL), stats_out(NULL),
+    stats_interval(0), next_stats(0), remote_bitbang(NULL),
     debug_module(this, progsize, max_bus_master_bits, require_authentication)
 {
   signal(SIGINT, &handle_signal);
+  signal(SIGUSR1, &handle_stats_signal);
 
   for (auto& x : mems)
     bus.add_device(x.first, x.second);
@@ -62,16 +73,35 @@ sim_t::sim_t(const char* isa, size_t nprocs, bool halted, reg_t start_pc,
   
   pfa.reset(new pfa_t(this));
   bus.add_device(PFA_BASE, pfa.get());
+  debug_mmu->set_pfa(pfa.get());
+  for (processor_t* p : procs)
+    p->get_mmu()->set_pfa(pfa.get());
 
   memblade.reset(new memblade_t(this));
   bus.add_device(MB_BASE, memblade.get());
 
   nic.reset(new nic_t());
   bus.add_device(NIC_BASE, nic.get());
+
+  for (size_t i = 0; i < procs.size(); i++) {
+    processor_t* p = procs[i];
+    int id = hartids.empty() ? i : hartids[i];
+    stats.add("hart" + std::to_string(id),
+              [p](stats_writer_t& w) { p->dump_stats(w); });
+  }
+  stats.add("pfa", [this](stats_writer_t& w) { pfa->dump_stats(w); });
+  stats.add("memblade", [this](stats_writer_t& w) { memblade->dump_stats(w); });
 }
 
 sim_t::~sim_t()
 {
+  for (size_t i = 0; i < procs.size(); i++) {
+    procs[i]->print_histogram(symtab, histogram_prefix);
+    if (callgraph_prefix)
+      procs[i]->print_callgraph(symtab, callgraph_prefix);
+  }
+  if (stats_out && stats_out != stderr)
+    fclose(stats_out);
   for (size_t i = 0; i < procs.size(); i++)
     delete procs[i];
   delete debug_mmu;
@@ -103,7 +133,12 @@ int sim_t::run()
 {
   host = context_t::current();
   target.init(sim_thread_main, this);
-  return htif_t::run();
+  int ret = htif_t::run();
+  pfa->flush_evictions();
+  // before main() tears down the caches registered by spike
+  if (stats_out)
+    dump_stats("exit");
+  return ret;
 }
 
 void sim_t::step(size_t n)
@@ -111,12 +146,30 @@ void sim_t::step(size_t n)
   for (size_t i = 0, steps = 0; i < n; i += steps)
   {
     steps = std::min(n - i, INTERLEAVE - current_step);
-    procs[current_proc]->step(steps);
+    if (unlikely(attach_hook || reset_stats_hook))
+      steps = std::min<uint64_t>(steps, next_phase - instret);
+    if (unlikely(stats_interval))
+      steps = std::min<uint64_t>(steps, next_stats - instret);
+    // a hart waiting on the PFA spends (part of) its turn idle
+    size_t idle = pfa->take_idle(current_proc, steps);
+    if (steps > idle)
+      procs[current_proc]->step(steps - idle);
 
     current_step += steps;
+    instret += steps - idle;
+    if (unlikely(attach_hook || reset_stats_hook) && instret == next_phase)
+      advance_phase();
+    if (unlikely(stats_interval) && instret == next_stats) {
+      dump_stats("interval");
+      next_stats += stats_interval;
+    }
     if (current_step == INTERLEAVE)
     {
       current_step = 0;
+      if (unlikely(stats_requested)) {
+        stats_requested = 0;
+        dump_stats("signal");
+      }
       procs[current_proc]->yield_load_reservation();
       if (++current_proc == procs.size()) {
         current_proc = 0;
@@ -128,6 +181,34 @@ void sim_t::step(size_t n)
   }
 }
 
+void sim_t::set_fast_forward(uint64_t fast_forward, uint64_t warmup,
+                             std::function<void()> attach,
+                             std::function<void()> reset_stats)
+{
+  attach_hook = attach;
+  reset_stats_hook = reset_stats;
+  this->warmup = warmup;
+  next_phase = instret + fast_forward;
+  if (next_phase == instret)
+    advance_phase();
+}
+
+void sim_t::advance_phase()
+{
+  if (attach_hook) {
+    attach_hook();
+    attach_hook = nullptr;
+    next_phase = instret + warmup;
+    if (next_phase != instret || !reset_stats_hook)
+      return;
+  }
+
+  if (reset_stats_hook) {
+    reset_stats_hook();
+    reset_stats_hook = nullptr;
+  }
+}
+
 void sim_t::set_debug(bool value)
 {
   debug = value;
@@ -146,6 +227,64 @@ void sim_t::set_histogram(bool value)
   }
 }
 
+void sim_t::set_bbv(const char* path, uint64_t interval)
+{
+  // one SimPoint file per hart; suffix the hart index when there are several
+  for (size_t i = 0; i < procs.size(); i++) {
+    std::string file = path;
+    if (procs.size() > 1)
+      file += "." + std::to_string(i);
+    procs[i]->set_bbv(file, interval);
+  }
+}
+
+void sim_t::set_stats_output(const char* path, uint64_t interval)
+{
+  stats_out = path ? fopen(path, "w") : stderr;
+  if (!stats_out) {
+    fprintf(stderr, "could not open %s for writing\n", path);
+    exit(1);
+  }
+  stats_interval = interval;
+  next_stats = instret + interval;
+}
+
+void sim_t::set_remote_store(remote_store_t* store)
+{
+  pfa->set_remote_store(store);
+  memblade->set_remote_store(store);
+  remote_mem.reset(store);
+}
+
+void sim_t::set_remote_mem(const char* path)
+{
+  set_remote_store(new file_store_t(path));
+}
+
+void sim_t::set_memblade_server(const char* name)
+{
+  set_remote_store(new shm_store_t(name));
+}
+
+void sim_t::dump_stats(const char* reason)
+{
+  stats.dump(stats_out ? stats_out : stderr, instret, reason);
+}
+
+void sim_t::set_callgraph(const char* prefix)
+{
+  callgraph_prefix = prefix;
+  for (size_t i = 0; i < procs.size(); i++)
+    procs[i]->set_callgraph(prefix != NULL);
+}
+
+void sim_t::set_commit_log(const char* path)
+{
+  commit_log.reset(new commit_log_writer_t(path));
+  for (size_t i = 0; i < procs.size(); i++)
+    procs[i]->set_commit_log(commit_log.get());
+}
+
 void sim_t::set_procs_debug(bool value)
 {
   for (size_t i=0; i< procs.size(); i++)
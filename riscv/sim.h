@@ -9,11 +9,16 @@
 #include "pfa.h"
 #include "memblade.h"
 #include "nic.h"
+#include "symtab.h"
+#include "commit_log.h"
+#include "stats.h"
+#include "remote_store.h"
 #include <fesvr/htif.h>
 #include <fesvr/context.h>
 #include <vector>
 #include <string>
 #include <memory>
+#include <functional>
 
 class mmu_t;
 class remote_bitbang_t;
@@ -46,12 +51,39 @@ public:
   void set_debug(bool value);
   void set_log(bool value);
   void set_histogram(bool value);
+  void set_histogram_output(const char* prefix) { histogram_prefix = prefix; }
+  // Add the function symbols of a target ELF file for profile output.
+  bool load_symbols(const char* path) { return symtab.load(path); }
+  void set_bbv(const char* path, uint64_t interval);
+  // Track guest call stacks and write flamegraph input to
+  // <prefix>.<hart>.<prv>.folded at exit.
+  void set_callgraph(const char* prefix);
+  // Write the commit log in binary form to path (see commit_log.h).
+  void set_commit_log(const char* path);
+  // Simulate fast_forward instructions (summed over all harts), then call
+  // attach() to hook up detailed models, simulate warmup more instructions,
+  // and finally call reset_stats() so statistics cover only the remainder.
+  void set_fast_forward(uint64_t fast_forward, uint64_t warmup,
+                        std::function<void()> attach,
+                        std::function<void()> reset_stats);
+  // Dump the statistics registry as JSON lines to path (stderr if NULL)
+  // every interval instructions, summed over all harts, and at exit; with
+  // interval 0 only at exit.  SIGUSR1 always dumps, to stderr by default.
+  void set_stats_output(const char* path, uint64_t interval);
+  stats_registry_t& get_stats() { return stats; }
+  // Keep the PFA's and the memory blade's remote pages in the sparse file
+  // at path, shared between them and kept from one run to the next.
+  void set_remote_mem(const char* path);
+  // Or keep them in the spike-memblade-server that created the shared
+  // memory object name, shared with every other simulator using it.
+  void set_memblade_server(const char* name);
   void set_procs_debug(bool value);
   void set_remote_bitbang(remote_bitbang_t* remote_bitbang) {
     this->remote_bitbang = remote_bitbang;
   }
   const char* get_dts() { if (dts.empty()) reset(); return dts.c_str(); }
   processor_t* get_core(size_t i) { return procs.at(i); }
+  pfa_t* get_pfa() { return pfa.get(); }
   unsigned nprocs() const { return procs.size(); }
 
   // Callback for processors to let the simulation know they were reset.
@@ -65,6 +97,8 @@ private:
   std::string dts;
   std::unique_ptr<rom_device_t> boot_rom;
   std::unique_ptr<clint_t> clint;
+  std::unique_ptr<remote_store_t> remote_mem; // NULL unless set_remote_mem or
+                                              // set_memblade_server was called
   std::unique_ptr<pfa_t> pfa;
   std::unique_ptr<memblade_t> memblade;
   std::unique_ptr<nic_t> nic;
@@ -72,14 +106,30 @@ private:
 
   processor_t* get_core(const std::string& i);
   void step(size_t n); // step through simulation
+  void set_remote_store(remote_store_t* store);
+  void advance_phase();
   static const size_t INTERLEAVE = 5000;
   static const size_t INSNS_PER_RTC_TICK = 100; // 10 MHz clock for 1 BIPS core
   static const size_t CPU_HZ = 1000000000; // 1GHz CPU
   size_t current_step;
   size_t current_proc;
+  uint64_t instret; // instructions simulated, summed over all harts
+  uint64_t next_phase; // instret at which the next phase hook fires
+  std::function<void()> attach_hook;
+  std::function<void()> reset_stats_hook;
+  uint64_t warmup;
   bool debug;
   bool log;
   bool histogram_enabled; // provide a histogram of PCs
+  const char* histogram_prefix;
+  const char* callgraph_prefix;
+  symtab_t symtab;
+  std::unique_ptr<commit_log_writer_t> commit_log;
+  stats_registry_t stats;
+  FILE* stats_out; // NULL unless set_stats_output was called
+  uint64_t stats_interval;
+  uint64_t next_stats; // instret at which the next periodic dump is made
+  void dump_stats(const char* reason);
   remote_bitbang_t* remote_bitbang;
 
   // memory-mapped I/O routines
@@ -0,0 +1,108 @@
+// See LICENSE for license details.
+
+#include "stackdist.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+static void help()
+{
+  std::cerr << "Stack distance configurations must be of the form" << std::endl;
+  std::cerr << "  sets:ways:blocksize" << std::endl;
+  std::cerr << "giving the largest number of sets and ways to evaluate, with" << std::endl;
+  std::cerr << "sets and blocksize both powers of two and blocksize at least 8." << std::endl;
+  exit(1);
+}
+
+stack_dist_sim_t::stack_dist_sim_t(const char* config)
+{
+  const char* wp = strchr(config, ':');
+  if (!wp++) help();
+  const char* bp = strchr(wp, ':');
+  if (!bp++) help();
+
+  size_t max_sets = atoi(std::string(config, wp).c_str());
+  max_ways = atoi(std::string(wp, bp).c_str());
+  linesz = atoi(bp);
+
+  if (max_sets == 0 || (max_sets & (max_sets-1)) || max_ways == 0)
+    help();
+  if (linesz < 8 || (linesz & (linesz-1)))
+    help();
+
+  idx_shift = 0;
+  for (size_t x = linesz; x > 1; x >>= 1)
+    idx_shift++;
+
+  for (size_t sets = 1; sets <= max_sets; sets *= 2) {
+    levels.push_back(level_t());
+    levels.back().sets = sets;
+    levels.back().stacks.resize(sets * max_ways, ~0ULL);
+  }
+  reset_stats();
+}
+
+stack_dist_sim_t::~stack_dist_sim_t()
+{
+  print_stats();
+}
+
+void stack_dist_sim_t::reset_stats()
+{
+  accesses = 0;
+  for (auto& l : levels)
+    l.depths.assign(max_ways + 1, 0);
+}
+
+void stack_dist_sim_t::trace(uint64_t addr, size_t bytes, access_type type)
+{
+  uint64_t line = addr >> idx_shift;
+  accesses++;
+
+  for (auto& l : levels) {
+    uint64_t* stack = &l.stacks[(line & (l.sets-1)) * max_ways];
+
+    size_t depth = 0;
+    while (depth < max_ways && stack[depth] != line)
+      depth++;
+    l.depths[depth]++;
+
+    // move to the top, dropping the bottom line on a miss
+    size_t n = depth < max_ways ? depth : max_ways - 1;
+    memmove(stack + 1, stack, n * sizeof(*stack));
+    stack[0] = line;
+  }
+}
+
+void stack_dist_sim_t::print_stats()
+{
+  if (accesses == 0)
+    return;
+
+  std::vector<size_t> ways;
+  for (size_t w = 1; w < max_ways; w *= 2)
+    ways.push_back(w);
+  ways.push_back(max_ways);
+
+  std::cout << "Stack distance miss rates (%) for " << linesz
+            << "-byte blocks, " << accesses << " accesses" << std::endl;
+  std::cout << std::setw(10) << "sets\\ways";
+  for (size_t w : ways)
+    std::cout << std::setw(8) << w;
+  std::cout << std::endl;
+
+  std::cout << std::setprecision(3) << std::fixed;
+  for (auto& l : levels) {
+    std::cout << std::setw(10) << l.sets;
+    uint64_t hits = 0;
+    size_t depth = 0;
+    for (size_t w : ways) {
+      for (; depth < w; depth++)
+        hits += l.depths[depth];
+      std::cout << std::setw(8) << 100.0 * (accesses - hits) / accesses;
+    }
+    std::cout << std::endl;
+  }
+}
@@ -0,0 +1,48 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_STACKDIST_H
+#define _RISCV_STACKDIST_H
+
+#include "memtracer.h"
+#include <cstdint>
+#include <vector>
+
+// Evaluates a whole grid of LRU data caches in one pass (Mattson et al.,
+// "Evaluation techniques for storage hierarchies", 1970).  For every
+// power-of-two set count up to a maximum, each set keeps an LRU stack of
+// up to max_ways lines, and each access records the depth at which its
+// line was found.  An access hits in a cache with that many sets and W
+// ways exactly when its depth is less than W, so one histogram per set
+// count yields the miss rate of every associativity.
+class stack_dist_sim_t : public memtracer_t
+{
+ public:
+  // config is "sets:ways:blocksize", the largest set count and
+  // associativity to report.
+  stack_dist_sim_t(const char* config);
+  ~stack_dist_sim_t();
+
+  bool interested_in_range(uint64_t begin, uint64_t end, access_type type)
+  {
+    return type == LOAD || type == STORE;
+  }
+  void trace(uint64_t addr, size_t bytes, access_type type);
+  void print_stats();
+  void reset_stats();
+
+ private:
+  struct level_t
+  {
+    size_t sets;
+    std::vector<uint64_t> stacks; // max_ways lines per set, most recent first
+    std::vector<uint64_t> depths; // depth histogram; [max_ways] counts misses
+  };
+
+  size_t max_ways;
+  size_t linesz;
+  size_t idx_shift;
+  uint64_t accesses;
+  std::vector<level_t> levels;
+};
+
+#endif
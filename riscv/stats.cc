@@ -0,0 +1,144 @@
+// See LICENSE for license details.
+
+#include "stats.h"
+#include <algorithm>
+#include <cinttypes>
+#include <cmath>
+
+static void write_string(FILE* out, const std::string& s)
+{
+  fputc('"', out);
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      fputc('\\', out);
+    if ((unsigned char)c >= 0x20) // drop control characters
+      fputc(c, out);
+  }
+  fputc('"', out);
+}
+
+stats_writer_t::stats_writer_t(FILE* out)
+  : out(out), first(1, true)
+{
+  fputc('{', out);
+}
+
+stats_writer_t::~stats_writer_t()
+{
+  fputs("}\n", out);
+  fflush(out);
+}
+
+void stats_writer_t::key(const std::string& name)
+{
+  if (!first.back())
+    fputc(',', out);
+  first.back() = false;
+
+  write_string(out, name);
+  fputc(':', out);
+}
+
+void stats_writer_t::begin(const std::string& name)
+{
+  key(name);
+  fputc('{', out);
+  first.push_back(true);
+}
+
+void stats_writer_t::end()
+{
+  fputc('}', out);
+  first.pop_back();
+}
+
+void stats_writer_t::add(const std::string& name, uint64_t value)
+{
+  key(name);
+  fprintf(out, "%" PRIu64, value);
+}
+
+void stats_writer_t::add(const std::string& name, double value)
+{
+  key(name);
+  // JSON has no NaN or infinity
+  if (std::isfinite(value))
+    fprintf(out, "%.6g", value);
+  else
+    fputs("null", out);
+}
+
+void stats_writer_t::add(const std::string& name, const std::string& value)
+{
+  key(name);
+  write_string(out, value);
+}
+
+void stats_histogram_t::add(uint64_t value)
+{
+  buckets[value ? 64 - __builtin_clzll(value) : 0]++;
+}
+
+void stats_histogram_t::dump(stats_writer_t& w, const std::string& name) const
+{
+  w.begin(name);
+  for (size_t i = 0; i < sizeof(buckets) / sizeof(buckets[0]); i++)
+    if (buckets[i])
+      w.add(std::to_string(i ? uint64_t(1) << (i - 1) : 0), buckets[i]);
+  w.end();
+}
+
+void stats_top_t::add(uint64_t key)
+{
+  size_t min = 0;
+  for (size_t i = 0; i < counts.size(); i++) {
+    if (counts[i].first == key) {
+      counts[i].second++;
+      return;
+    }
+    if (counts[i].second < counts[min].second)
+      min = i;
+  }
+
+  if (counts.size() < CAPACITY) {
+    counts.push_back(std::make_pair(key, uint64_t(1)));
+  } else {
+    counts[min].first = key;
+    counts[min].second++;
+  }
+}
+
+void stats_top_t::dump(stats_writer_t& w, const std::string& name, size_t n) const
+{
+  std::vector<std::pair<uint64_t, uint64_t>> top(counts);
+  n = std::min(n, top.size());
+  std::partial_sort(top.begin(), top.begin() + n, top.end(),
+      [](const std::pair<uint64_t, uint64_t>& a, const std::pair<uint64_t, uint64_t>& b) {
+        return a.second != b.second ? a.second > b.second : a.first < b.first;
+      });
+
+  w.begin(name);
+  for (size_t i = 0; i < n; i++) {
+    char key[32];
+    snprintf(key, sizeof(key), "0x%lx", (unsigned long)top[i].first);
+    w.add(key, top[i].second);
+  }
+  w.end();
+}
+
+void stats_registry_t::add(const std::string& name, source_t source)
+{
+  sources.push_back(std::make_pair(name, source));
+}
+
+void stats_registry_t::dump(FILE* out, uint64_t instret, const char* reason)
+{
+  stats_writer_t w(out);
+  w.add("instret", instret);
+  w.add("reason", std::string(reason));
+  for (auto& s : sources) {
+    w.begin(s.first);
+    s.second(w);
+    w.end();
+  }
+}
@@ -0,0 +1,85 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_STATS_H
+#define _RISCV_STATS_H
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Writes one JSON object.  Members are written in the order they are
+// added; objects nest with begin()/end().
+class stats_writer_t
+{
+ public:
+  stats_writer_t(FILE* out);
+  ~stats_writer_t();
+
+  void begin(const std::string& name);
+  void end();
+  void add(const std::string& name, uint64_t value);
+  void add(const std::string& name, double value);
+  void add(const std::string& name, const std::string& value);
+
+ private:
+  FILE* out;
+  std::vector<bool> first; // per open object: no member written yet
+  void key(const std::string& name);
+};
+
+// Counts of values in power-of-two buckets: 0, 1, 2-3, 4-7, and so on.
+class stats_histogram_t
+{
+ public:
+  stats_histogram_t() : buckets() {}
+
+  void add(uint64_t value);
+  // Write an object with a member per non-empty bucket, named by the
+  // smallest value the bucket holds.
+  void dump(stats_writer_t& w, const std::string& name) const;
+
+ private:
+  uint64_t buckets[65];
+};
+
+// Approximate counts of the most frequent keys in bounded space, by the
+// space-saving algorithm: once CAPACITY keys are tracked, a new key takes
+// over the least counted one and its count, so a count can overestimate
+// by at most what it took over.
+class stats_top_t
+{
+ public:
+  static const size_t CAPACITY = 64;
+
+  void add(uint64_t key);
+  // Write an object with the n most counted keys, named "0x<key>", most
+  // counted first and ties broken by key.
+  void dump(stats_writer_t& w, const std::string& name, size_t n) const;
+
+ private:
+  std::vector<std::pair<uint64_t, uint64_t>> counts; // (key, count)
+};
+
+// Named sources of statistics, each writing its counters into its own
+// JSON object when the registry is dumped.
+class stats_registry_t
+{
+ public:
+  typedef std::function<void(stats_writer_t&)> source_t;
+
+  // Sources are dumped in the order they are added.
+  void add(const std::string& name, source_t source);
+  bool empty() const { return sources.empty(); }
+
+  // Write every source as one line of JSON, an object holding the
+  // instruction count, why the dump was made, and one member per source.
+  void dump(FILE* out, uint64_t instret, const char* reason);
+
+ private:
+  std::vector<std::pair<std::string, source_t>> sources;
+};
+
+#endif
@@ -0,0 +1,91 @@
+// See LICENSE for license details.
+
+#include "symtab.h"
+#include <elf.h>
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <cstring>
+
+bool symtab_t::load(const char* path)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in)
+    return false;
+  std::vector<char> elf((std::istreambuf_iterator<char>(in)),
+                        std::istreambuf_iterator<char>());
+
+  if (elf.size() < EI_NIDENT || memcmp(&elf[0], ELFMAG, SELFMAG) != 0)
+    return false;
+
+  if (elf[EI_CLASS] == ELFCLASS32)
+    load_symbols<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(elf);
+  else if (elf[EI_CLASS] == ELFCLASS64)
+    load_symbols<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(elf);
+  else
+    return false;
+
+  std::sort(symbols.begin(), symbols.end(),
+            [](const symbol_t& a, const symbol_t& b) { return a.addr < b.addr; });
+  symbols.erase(std::unique(symbols.begin(), symbols.end(),
+                            [](const symbol_t& a, const symbol_t& b) { return a.addr == b.addr; }),
+                symbols.end());
+  return true;
+}
+
+template<class ehdr_t, class shdr_t, class sym_t>
+void symtab_t::load_symbols(const std::vector<char>& elf)
+{
+  if (elf.size() < sizeof(ehdr_t))
+    return;
+  const ehdr_t* eh = (const ehdr_t*)&elf[0];
+  if (eh->e_shoff + (size_t)eh->e_shnum * sizeof(shdr_t) > elf.size())
+    return;
+  const shdr_t* sh = (const shdr_t*)&elf[eh->e_shoff];
+
+  for (unsigned i = 0; i < eh->e_shnum; i++) {
+    if (sh[i].sh_type != SHT_SYMTAB || sh[i].sh_link >= eh->e_shnum)
+      continue;
+    const shdr_t& strtab = sh[sh[i].sh_link];
+    if (sh[i].sh_offset + sh[i].sh_size > elf.size() ||
+        strtab.sh_offset + strtab.sh_size > elf.size())
+      continue;
+
+    const sym_t* syms = (const sym_t*)&elf[sh[i].sh_offset];
+    const char* strs = &elf[strtab.sh_offset];
+    for (size_t j = 0; j < sh[i].sh_size / sizeof(sym_t); j++) {
+      if (ELF64_ST_TYPE(syms[j].st_info) != STT_FUNC ||
+          syms[j].st_shndx == SHN_UNDEF || syms[j].st_name >= strtab.sh_size)
+        continue;
+      const char* name = strs + syms[j].st_name;
+      symbols.push_back({syms[j].st_value, syms[j].st_size,
+                         std::string(name, strnlen(name, strtab.sh_size - syms[j].st_name))});
+    }
+  }
+}
+
+const symtab_t::symbol_t* symtab_t::lookup(reg_t addr) const
+{
+  auto it = std::upper_bound(symbols.begin(), symbols.end(), addr,
+                             [](reg_t a, const symbol_t& s) { return a < s.addr; });
+  if (it == symbols.begin())
+    return NULL;
+  --it;
+  if (it->size != 0 && addr - it->addr >= it->size)
+    return NULL;
+  return &*it;
+}
+
+std::string symtab_t::describe(reg_t addr) const
+{
+  std::ostringstream s;
+  if (const symbol_t* sym = lookup(addr)) {
+    s << sym->name;
+    if (addr != sym->addr)
+      s << "+0x" << std::hex << addr - sym->addr;
+  } else {
+    s << "0x" << std::hex << addr;
+  }
+  return s.str();
+}
@@ -0,0 +1,41 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_SYMTAB_H
+#define _RISCV_SYMTAB_H
+
+#include "decode.h"
+#include <string>
+#include <vector>
+
+// Function symbols read from the .symtab of one or more target ELF files,
+// used to attribute PCs to functions in profiles.
+class symtab_t
+{
+ public:
+  struct symbol_t
+  {
+    reg_t addr;
+    reg_t size;
+    std::string name;
+  };
+
+  // Add the function symbols of an ELF file.  Returns false if the file
+  // cannot be read or is not an ELF file.
+  bool load(const char* path);
+  bool empty() const { return symbols.empty(); }
+
+  // The symbol containing addr, or NULL.  Symbols of unknown size extend to
+  // the next symbol.
+  const symbol_t* lookup(reg_t addr) const;
+
+  // "name+0xoff" for addr, or its hex value when no symbol covers it.
+  std::string describe(reg_t addr) const;
+
+ private:
+  std::vector<symbol_t> symbols; // sorted by address
+
+  template<class ehdr_t, class shdr_t, class sym_t>
+  void load_symbols(const std::vector<char>& elf);
+};
+
+#endif
@@ -0,0 +1,79 @@
+// See LICENSE for license details.
+
+#include "timing.h"
+#include "config_list.h"
+#include "stats.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+static void help()
+{
+  std::cerr << "Timing configurations must be comma-separated lists of" << std::endl;
+  std::cerr << "  name=cycles" << std::endl;
+  std::cerr << "where name is one of mul, div, fp, fdiv, branch, l1-miss," << std::endl;
+  std::cerr << "or l2-miss." << std::endl;
+  exit(1);
+}
+
+void timing_config_t::parse(const char* spec)
+{
+  parse_config_list(spec, [this](const std::string& name, uint64_t cycles) {
+    if (name == "mul") mul = cycles;
+    else if (name == "div") div = cycles;
+    else if (name == "fp") fp = cycles;
+    else if (name == "fdiv") fdiv = cycles;
+    else if (name == "branch") branch = cycles;
+    else if (name == "l1-miss") l1_miss = cycles;
+    else if (name == "l2-miss") l2_miss = cycles;
+    else return false;
+    return true;
+  }, &help);
+}
+
+void timing_model_t::reset()
+{
+  compute_stalls = 0;
+  branch_stalls = 0;
+  memory_stalls = 0;
+  remote_stalls = 0;
+  remote_fetches = 0;
+  adjust = 0;
+}
+
+void timing_model_t::dump_stats(stats_writer_t& w)
+{
+  w.add("compute_stalls", compute_stalls);
+  w.add("branch_stalls", branch_stalls);
+  w.add("memory_stalls", memory_stalls);
+  w.add("remote_fetches", remote_fetches);
+  w.add("remote_stalls", remote_stalls);
+}
+
+void timing_model_t::print_stats(const char* name, uint64_t instret)
+{
+  if (instret == 0)
+    return;
+
+  uint64_t cycles = instret + stalls();
+
+  std::cout << std::setprecision(3) << std::fixed;
+  std::cout << name << " ";
+  std::cout << "Instructions:          " << instret << std::endl;
+  std::cout << name << " ";
+  std::cout << "Cycles:                " << cycles << std::endl;
+  std::cout << name << " ";
+  std::cout << "CPI:                   " << double(cycles) / instret << std::endl;
+  std::cout << name << " ";
+  std::cout << "Compute Stalls:        " << compute_stalls << std::endl;
+  std::cout << name << " ";
+  std::cout << "Branch Stalls:         " << branch_stalls << std::endl;
+  std::cout << name << " ";
+  std::cout << "Memory Stalls:         " << memory_stalls << std::endl;
+  std::cout << name << " ";
+  std::cout << "Remote Fetches:        " << remote_fetches << std::endl;
+  std::cout << name << " ";
+  std::cout << "Remote Stalls:         " << remote_stalls << std::endl;
+}
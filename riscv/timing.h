@@ -0,0 +1,92 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_TIMING_H
+#define _RISCV_TIMING_H
+
+#include "decode.h"
+#include <cstdint>
+
+class stats_writer_t;
+
+// Extra cycles charged on top of one cycle per instruction.  The cache
+// miss penalties are applied by the cache models (see
+// cache_sim_t::set_miss_penalty), so they only count when --ic, --dc or
+// --l2 are given.
+struct timing_config_t
+{
+  uint64_t mul = 2;
+  uint64_t div = 32;
+  uint64_t fp = 3;
+  uint64_t fdiv = 20;      // FP divide and square root
+  uint64_t branch = 2;     // taken branches and jumps
+  uint64_t l1_miss = 10;   // a miss in the I$ or D$ served by the next level
+  uint64_t l2_miss = 80;   // a miss in the L2, served by memory
+
+  // spec is a comma-separated list of name=cycles, each name being one of
+  // the fields above (l1_miss as l1-miss, and so on).  Exits with a usage
+  // message if it is malformed.
+  void parse(const char* spec);
+};
+
+// Estimates a hart's cycle count: one cycle per instruction plus the
+// latencies above, plus the PFA's remote fetches (see pfa_config_t).  Only
+// stalls are accumulated here; mcycle reads minstret plus stalls(), so the
+// two stay in step however minstret moves.
+class timing_model_t
+{
+ public:
+  timing_model_t(const timing_config_t& config) : config(config) { reset(); }
+
+  void reset();
+  uint64_t stalls()
+  {
+    return compute_stalls + branch_stalls + memory_stalls + remote_stalls + adjust;
+  }
+  // Make stalls() return s, after a write to mcycle or minstret.
+  void set_stalls(uint64_t s) { adjust += s - stalls(); }
+
+  void step(reg_t pc, reg_t npc, insn_t insn)
+  {
+    uint64_t bits = insn.bits();
+    switch (bits & 0x7f) {
+      case 0x33: // OP
+      case 0x3b: // OP-32
+        if (((bits >> 25) & 0x7f) == 1) // M extension
+          compute_stalls += insn.rm() < 4 ? config.mul : config.div;
+        break;
+      case 0x53: { // OP-FP
+        unsigned funct5 = (bits >> 27) & 0x1f;
+        compute_stalls += funct5 == 0x03 || funct5 == 0x0b ? config.fdiv : config.fp;
+        break;
+      }
+      case 0x43: case 0x47: case 0x4b: case 0x4f: // fused multiply-add
+        compute_stalls += config.fp;
+        break;
+    }
+    if (npc != pc + insn_length(bits))
+      branch_stalls += config.branch;
+  }
+  // Counters the cache and TLB models add miss penalties to.
+  uint64_t* memory_stall_counter() { return &memory_stalls; }
+  void remote_fetch(uint64_t cycles)
+  {
+    remote_stalls += cycles;
+    remote_fetches++;
+  }
+  // A wait for a prefetched page still on its way.
+  void remote_wait(uint64_t cycles) { remote_stalls += cycles; }
+
+  void print_stats(const char* name, uint64_t instret);
+  void dump_stats(stats_writer_t& w);
+
+ private:
+  timing_config_t config;
+  uint64_t compute_stalls;
+  uint64_t branch_stalls;
+  uint64_t memory_stalls;
+  uint64_t remote_stalls;
+  uint64_t remote_fetches;
+  uint64_t adjust; // from CSR writes; may wrap
+};
+
+#endif
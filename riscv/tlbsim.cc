@@ -0,0 +1,231 @@
+// See LICENSE for license details.
+
+#include "tlbsim.h"
+#include "cachesim.h"
+#include "mmu.h"
+#include "stats.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+
+static void help()
+{
+  std::cerr << "TLB configurations must be of the form" << std::endl;
+  std::cerr << "  sets:ways" << std::endl;
+  std::cerr << "where sets is a power of two and ways is at most 256." << std::endl;
+  exit(1);
+}
+
+tlb_t* tlb_t::construct(const char* config, const char* name)
+{
+  const char* wp = strchr(config, ':');
+  if (!wp++) help();
+
+  size_t sets = atoi(std::string(config, wp).c_str());
+  size_t ways = atoi(wp);
+  if (sets == 0 || (sets & (sets-1)) || ways == 0 || ways > 256)
+    help();
+  return new tlb_t(sets, ways, name);
+}
+
+tlb_t::tlb_t(size_t sets, size_t ways, const char* name)
+  : sets(sets), ways(ways), entries(sets * ways), page_shifts(0), name(name)
+{
+  policy = replacement_policy_t::construct("lru", sets, ways);
+  reset_stats();
+}
+
+tlb_t::tlb_t(const tlb_t& rhs)
+  : sets(rhs.sets), ways(rhs.ways), entries(sets * ways), page_shifts(0),
+    name(rhs.name)
+{
+  policy = replacement_policy_t::construct("lru", sets, ways);
+  reset_stats();
+}
+
+tlb_t::~tlb_t()
+{
+  print_stats();
+  delete policy;
+}
+
+void tlb_t::reset_stats()
+{
+  accesses = 0;
+  misses = 0;
+}
+
+void tlb_t::print_stats()
+{
+  if (accesses == 0)
+    return;
+
+  float mr = 100.0f*misses/accesses;
+
+  std::cout << std::setprecision(3) << std::fixed;
+  std::cout << name << " ";
+  std::cout << "Accesses:              " << accesses << std::endl;
+  std::cout << name << " ";
+  std::cout << "Misses:                " << misses << std::endl;
+  std::cout << name << " ";
+  std::cout << "Miss Rate:             " << mr << '%' << std::endl;
+}
+
+void tlb_t::dump_stats(stats_writer_t& w)
+{
+  w.add("accesses", accesses);
+  w.add("misses", misses);
+}
+
+int tlb_t::lookup(uint64_t vaddr, uint64_t context)
+{
+  accesses++;
+  for (uint64_t shifts = page_shifts; shifts; shifts &= shifts - 1) {
+    int shift = __builtin_ctzll(shifts);
+    uint64_t vpn = vaddr >> shift;
+    size_t set = vpn & (sets-1);
+    entry_t* e = &entries[set * ways];
+    for (size_t way = 0; way < ways; way++) {
+      if (e[way].vpn == vpn && e[way].page_shift == shift &&
+          e[way].context == context) {
+        policy->hit(set, way);
+        return shift;
+      }
+    }
+  }
+  misses++;
+  return 0;
+}
+
+void tlb_t::fill(uint64_t vaddr, int page_shift, uint64_t context)
+{
+  uint64_t vpn = vaddr >> page_shift;
+  size_t set = vpn & (sets-1);
+  entry_t* e = &entries[set * ways];
+
+  size_t way = 0;
+  while (way < ways && e[way].page_shift != 0)
+    way++;
+  if (way == ways)
+    way = policy->victim(set);
+
+  e[way].vpn = vpn;
+  e[way].context = context;
+  e[way].page_shift = page_shift;
+  policy->fill(set, way);
+  page_shifts |= uint64_t(1) << page_shift;
+}
+
+tlb_sim_t::tlb_sim_t(const char* i, const char* d, const char* l2)
+  : itlb(i ? tlb_t::construct(i, "ITLB") : NULL),
+    dtlb(d ? tlb_t::construct(d, "DTLB") : NULL),
+    l2tlb(l2 ? tlb_t::construct(l2, "L2TLB") : NULL),
+    mmu(NULL), walk_cache(NULL), stalls(NULL), walker_name("PTW")
+{
+  reset_stats();
+}
+
+tlb_sim_t::tlb_sim_t(const tlb_sim_t& rhs)
+  : itlb(rhs.itlb ? new tlb_t(*rhs.itlb) : NULL),
+    dtlb(rhs.dtlb ? new tlb_t(*rhs.dtlb) : NULL),
+    l2tlb(rhs.l2tlb ? new tlb_t(*rhs.l2tlb) : NULL),
+    mmu(NULL), walk_cache(NULL), stalls(NULL), walker_name(rhs.walker_name)
+{
+  reset_stats();
+}
+
+tlb_sim_t::~tlb_sim_t()
+{
+  // the TLBs print their own statistics as they are destroyed
+  itlb.reset();
+  dtlb.reset();
+  l2tlb.reset();
+  print_stats();
+}
+
+void tlb_sim_t::set_name_suffix(const std::string& suffix)
+{
+  if (itlb) itlb->set_name("ITLB" + suffix);
+  if (dtlb) dtlb->set_name("DTLB" + suffix);
+  if (l2tlb) l2tlb->set_name("L2TLB" + suffix);
+  walker_name = "PTW" + suffix;
+}
+
+void tlb_sim_t::reset_stats()
+{
+  if (itlb) itlb->reset_stats();
+  if (dtlb) dtlb->reset_stats();
+  if (l2tlb) l2tlb->reset_stats();
+  walks = 0;
+  pte_reads = 0;
+  superpage_walks = 0;
+}
+
+void tlb_sim_t::print_stats()
+{
+  if (walks == 0)
+    return;
+
+  std::cout << walker_name << " ";
+  std::cout << "Walks:                 " << walks << std::endl;
+  std::cout << walker_name << " ";
+  std::cout << "PTE Reads:             " << pte_reads << std::endl;
+  std::cout << walker_name << " ";
+  std::cout << "Superpage Walks:       " << superpage_walks << std::endl;
+}
+
+void tlb_sim_t::dump_stats(stats_writer_t& w)
+{
+  for (tlb_t* t : {itlb.get(), dtlb.get(), l2tlb.get()}) {
+    if (t) {
+      w.begin(t->get_name());
+      t->dump_stats(w);
+      w.end();
+    }
+  }
+  w.begin(walker_name);
+  w.add("walks", walks);
+  w.add("pte_reads", pte_reads);
+  w.add("superpage_walks", superpage_walks);
+  w.end();
+}
+
+void tlb_sim_t::trace_vaddr(uint64_t vaddr, uint64_t paddr, size_t bytes,
+                            access_type type, uint64_t pc)
+{
+  uint64_t context = mmu->vm_context(type);
+  if (context == 0)
+    return;
+
+  tlb_t* l1 = type == FETCH ? itlb.get() : dtlb.get();
+  if (l1 && l1->lookup(vaddr, context))
+    return;
+
+  int page_shift = l2tlb ? l2tlb->lookup(vaddr, context) : 0;
+  if (page_shift == 0) {
+    page_walk_t walk;
+    mmu->trace_walk(vaddr, type, &walk);
+    if (walk.levels == 0)
+      return;
+
+    walks++;
+    pte_reads += walk.levels;
+    if (walk.page_shift > PGSHIFT)
+      superpage_walks++;
+    if (walk_cache) {
+      for (size_t i = 0; i < walk.levels; i++) {
+        uint64_t cycles = walk_cache->access(walk.pte_addr[i], walk.pte_bytes, false);
+        if (stalls)
+          *stalls += cycles;
+      }
+    }
+
+    page_shift = walk.page_shift;
+    if (l2tlb)
+      l2tlb->fill(vaddr, page_shift, context);
+  }
+
+  if (l1)
+    l1->fill(vaddr, page_shift, context);
+}
@@ -0,0 +1,110 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_TLB_SIM_H
+#define _RISCV_TLB_SIM_H
+
+#include "memtracer.h"
+#include "replacement.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class mmu_t;
+class cache_sim_t;
+class stats_writer_t;
+
+// One level of a target TLB: set-associative with LRU replacement,
+// holding translations of any page size.  Entries are tagged with their
+// page size and the satp they were walked under, and a lookup probes the
+// set for each page size the TLB currently holds.
+class tlb_t
+{
+ public:
+  tlb_t(size_t sets, size_t ways, const char* name);
+  // Copies the geometry; the copy starts empty with fresh statistics.
+  tlb_t(const tlb_t& rhs);
+  ~tlb_t();
+
+  // Returns the log2 page size of the entry translating vaddr, 0 on a miss.
+  int lookup(uint64_t vaddr, uint64_t context);
+  void fill(uint64_t vaddr, int page_shift, uint64_t context);
+  void print_stats();
+  void dump_stats(stats_writer_t& w);
+  void reset_stats();
+  void set_name(const std::string& n) { name = n; }
+  const std::string& get_name() const { return name; }
+
+  // config is "sets:ways"; exits with a usage message if it is malformed.
+  static tlb_t* construct(const char* config, const char* name);
+
+ private:
+  struct entry_t
+  {
+    uint64_t vpn;      // vaddr >> page_shift
+    uint64_t context;
+    uint8_t page_shift; // 0 if the entry is empty
+  };
+
+  size_t sets;
+  size_t ways;
+  std::vector<entry_t> entries;
+  replacement_policy_t* policy;
+  uint64_t page_shifts; // bit n set once an entry with page_shift n is filled
+
+  uint64_t accesses;
+  uint64_t misses;
+  std::string name;
+};
+
+// Models a hart's target TLBs: optional L1 instruction and data TLBs
+// backed by an optional unified L2 TLB.  A translation that misses in all
+// of them is walked, and the walker's PTE reads are sent to the cache the
+// walker would use, normally the hart's D$.
+//
+// Entries are never flushed by SFENCE.VMA; tagging them with satp keeps
+// address spaces apart, which is enough for miss-rate estimates.
+class tlb_sim_t : public memtracer_t
+{
+ public:
+  // Any of the configs may be NULL to leave that TLB out.
+  tlb_sim_t(const char* itlb, const char* dtlb, const char* l2tlb);
+  // Copies the configuration; the copy is not attached to an MMU.
+  tlb_sim_t(const tlb_sim_t& rhs);
+  ~tlb_sim_t();
+
+  void set_mmu(mmu_t* m) { mmu = m; }
+  void set_walk_cache(cache_sim_t* c) { walk_cache = c; }
+  // Add the cache stalls of each walk to *counter, for a timing model.
+  void set_stall_counter(uint64_t* counter) { stalls = counter; }
+  // Appended to the TLB names, to tell harts apart.
+  void set_name_suffix(const std::string& suffix);
+
+  bool interested_in_range(uint64_t begin, uint64_t end, access_type type)
+  {
+    return l2tlb || (type == FETCH ? itlb : dtlb);
+  }
+  // Without a virtual address there is nothing to translate.
+  void trace(uint64_t addr, size_t bytes, access_type type) {}
+  void trace_vaddr(uint64_t vaddr, uint64_t paddr, size_t bytes,
+                   access_type type, uint64_t pc);
+  void print_stats();
+  // One object per TLB, plus one for the walker.
+  void dump_stats(stats_writer_t& w);
+  void reset_stats();
+
+ private:
+  std::unique_ptr<tlb_t> itlb;
+  std::unique_ptr<tlb_t> dtlb;
+  std::unique_ptr<tlb_t> l2tlb;
+  mmu_t* mmu;
+  cache_sim_t* walk_cache;
+  uint64_t* stalls;
+  std::string walker_name;
+
+  uint64_t walks;
+  uint64_t pte_reads;
+  uint64_t superpage_walks;
+};
+
+#endif
@@ -0,0 +1,62 @@
+// See LICENSE for license details.
+
+// Measures cache model throughput for caches of equal capacity and
+// increasing associativity, with scalar and (if the host has them) SIMD
+// tag compares.  SIMD compares are only used from 8 ways up, so both rows
+// for 4 ways measure the scalar loop.  Build with "make cachesim-bench".
+
+#include "cachesim.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+#include <fesvr/option_parser.h>
+
+static void help()
+{
+  fprintf(stderr, "usage: cachesim-bench [--size=<KiB>] [--accesses=<n>]\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  size_t size_kb = 1024;
+  size_t accesses = 20000000;
+  const size_t linesz = 64;
+
+  option_parser_t parser;
+  parser.help(&help);
+  parser.option('h', 0, 0, [&](const char* s){help();});
+  parser.option(0, "size", 1, [&](const char* s){size_kb = strtoull(s, 0, 0);});
+  parser.option(0, "accesses", 1, [&](const char* s){accesses = strtoull(s, 0, 0);});
+  parser.parse(argv);
+
+  // Addresses are drawn from a footprint 1.5x the cache size, giving a mix
+  // of hits and misses typical of an LLC.
+  size_t lines = size_kb * 1024 / linesz;
+  std::vector<uint64_t> trace(1 << 20);
+  lfsr_t lfsr;
+  for (auto& addr : trace)
+    addr = uint64_t(lfsr.next() % (lines + lines / 2)) * linesz;
+
+  printf("%8s %8s %8s %12s\n", "ways", "compare", "Macc/s", "ns/access");
+  for (size_t ways : {4, 16, 32}) {
+    for (bool simd : {false, true}) {
+      std::string config = std::to_string(lines / ways) + ":" +
+                           std::to_string(ways) + ":" + std::to_string(linesz);
+      std::unique_ptr<cache_sim_t> cache(cache_sim_t::construct(config.c_str(), "bench"));
+      cache->use_vector_compare(simd);
+
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < accesses; i++)
+        cache->access(trace[i & (trace.size() - 1)], 8, i % 4 == 0);
+      std::chrono::duration<double> t = std::chrono::steady_clock::now() - start;
+
+      printf("%8zu %8s %8.1f %12.2f\n", ways, simd ? "simd" : "scalar",
+             accesses / t.count() / 1e6, t.count() * 1e9 / accesses);
+      cache->reset_stats();
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,210 @@
+// See LICENSE for license details.
+
+// Replays a memory trace written with spike --mem-trace=<file> through one
+// or more cache hierarchies, each built like spike's --ic/--dc/--l2 models:
+// private L1s per hart, coherent when there are several harts, sharing an
+// L2.  Hierarchies are independent, so they are simulated in parallel.
+
+#include "cachesim.h"
+#include "memtrace.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fesvr/option_parser.h>
+
+static void help()
+{
+  fprintf(stderr, "usage: spike-cache-replay [options] <trace file>\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --ic=<S>:<W>:<B>[:<P>]  Configure one hierarchy, as for spike\n");
+  fprintf(stderr, "  --dc=<S>:<W>:<B>[:<P>]\n");
+  fprintf(stderr, "  --l2=<S>:<W>:<B>[:<P>]\n");
+  fprintf(stderr, "  --hier=ic=<cfg>,dc=<cfg>,l2=<cfg>\n");
+  fprintf(stderr, "                          Add a hierarchy; any level may be omitted.\n");
+  fprintf(stderr, "                          May be given more than once.\n");
+  fprintf(stderr, "  --threads=<n>           Simulate up to n hierarchies at once\n");
+  fprintf(stderr, "                          [default: number of host CPUs]\n");
+  fprintf(stderr, "Traces do not record PCs, so stride prefetchers never trigger.\n");
+  exit(1);
+}
+
+struct hierarchy_t
+{
+  std::string ic_config, dc_config, l2_config;
+  std::unique_ptr<cache_sim_t> l2;
+  coherence_bus_t bus;
+  std::vector<std::unique_ptr<icache_sim_t>> ics;
+  std::vector<std::unique_ptr<dcache_sim_t>> dcs;
+
+  std::string describe() const
+  {
+    std::string s;
+    if (!ic_config.empty()) s += " --ic=" + ic_config;
+    if (!dc_config.empty()) s += " --dc=" + dc_config;
+    if (!l2_config.empty()) s += " --l2=" + l2_config;
+    return s;
+  }
+
+  void build(size_t nharts)
+  {
+    if (!l2_config.empty())
+      l2.reset(cache_sim_t::construct(l2_config.c_str(), "L2$"));
+    std::unique_ptr<icache_sim_t> ic(ic_config.empty() ? NULL : new icache_sim_t(ic_config.c_str()));
+    std::unique_ptr<dcache_sim_t> dc(dc_config.empty() ? NULL : new dcache_sim_t(dc_config.c_str()));
+    if (ic && l2) ic->set_miss_handler(&*l2);
+    if (dc && l2) dc->set_miss_handler(&*l2);
+
+    for (size_t i = 0; i < nharts; i++) {
+      std::string suffix = nharts > 1 ? std::to_string(i) : "";
+      ics.emplace_back(ic ? new icache_sim_t(*ic) : NULL);
+      dcs.emplace_back(dc ? new dcache_sim_t(*dc) : NULL);
+      if (ic) ics[i]->set_name("I$" + suffix);
+      if (dc) dcs[i]->set_name("D$" + suffix);
+      if (ic && nharts > 1) ics[i]->set_coherence_bus(&bus);
+      if (dc && nharts > 1) dcs[i]->set_coherence_bus(&bus);
+    }
+  }
+
+  void replay(const uint8_t* data, size_t size)
+  {
+    mem_trace_reader_t reader;
+    reader.open(data, size);
+    mem_trace_record_t rec;
+    while (reader.next(rec)) {
+      memtracer_t* t = rec.type == FETCH ? (memtracer_t*)ics[rec.hart].get()
+                                         : (memtracer_t*)dcs[rec.hart].get();
+      if (t)
+        t->trace(rec.addr, rec.bytes, rec.type);
+    }
+  }
+
+  // Destroying the caches prints their statistics, L1s first.
+  void finish()
+  {
+    ics.clear();
+    dcs.clear();
+    l2.reset();
+  }
+};
+
+static void parse_hier(const char* s, hierarchy_t& h)
+{
+  std::string spec(s);
+  size_t start = 0;
+  while (start < spec.size()) {
+    size_t end = spec.find(',', start);
+    if (end == std::string::npos)
+      end = spec.size();
+    std::string item = spec.substr(start, end - start);
+    if (item.compare(0, 3, "ic=") == 0)
+      h.ic_config = item.substr(3);
+    else if (item.compare(0, 3, "dc=") == 0)
+      h.dc_config = item.substr(3);
+    else if (item.compare(0, 3, "l2=") == 0)
+      h.l2_config = item.substr(3);
+    else
+      help();
+    start = end + 1;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  std::vector<hierarchy_t> hiers;
+  hierarchy_t single;
+  size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+  option_parser_t parser;
+  parser.help(&help);
+  parser.option('h', 0, 0, [&](const char* s){help();});
+  parser.option(0, "ic", 1, [&](const char* s){single.ic_config = s;});
+  parser.option(0, "dc", 1, [&](const char* s){single.dc_config = s;});
+  parser.option(0, "l2", 1, [&](const char* s){single.l2_config = s;});
+  parser.option(0, "hier", 1, [&](const char* s){
+    hiers.emplace_back();
+    parse_hier(s, hiers.back());
+  });
+  parser.option(0, "threads", 1, [&](const char* s){threads = std::max(1, atoi(s));});
+  auto argv1 = parser.parse(argv);
+  if (!*argv1)
+    help();
+
+  if (!single.describe().empty())
+    hiers.insert(hiers.begin(), std::move(single));
+  if (hiers.empty()) {
+    fprintf(stderr, "spike-cache-replay: no cache hierarchy configured\n");
+    return 1;
+  }
+
+  int fd = open(*argv1, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) < 0) {
+    fprintf(stderr, "spike-cache-replay: unable to open '%s': %s\n", *argv1,
+            strerror(errno));
+    return 1;
+  }
+  size_t size = st.st_size;
+  const uint8_t* data = size == 0 ? NULL :
+    (const uint8_t*)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED)
+    data = NULL;
+
+  // One quick pass to find how many harts the trace covers.
+  mem_trace_reader_t reader;
+  if (!data || !reader.open(data, size)) {
+    fprintf(stderr, "spike-cache-replay: '%s' is not a spike memory trace\n", *argv1);
+    return 1;
+  }
+  mem_trace_record_t rec;
+  size_t nharts = 1;
+  uint64_t records = 0;
+  while (reader.next(rec)) {
+    nharts = std::max(nharts, size_t(rec.hart) + 1);
+    records++;
+  }
+
+  for (auto& h : hiers)
+    h.build(nharts);
+
+  auto start = std::chrono::steady_clock::now();
+  std::atomic<size_t> next(0);
+  auto worker = [&]() {
+    for (size_t i; (i = next++) < hiers.size(); )
+      hiers[i].replay(data, size);
+  };
+  std::vector<std::thread> pool;
+  for (size_t i = 1; i < std::min(threads, hiers.size()); i++)
+    pool.emplace_back(worker);
+  worker();
+  for (auto& t : pool)
+    t.join();
+  std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+  for (size_t i = 0; i < hiers.size(); i++) {
+    printf("Configuration %zu:%s\n", i, hiers[i].describe().c_str());
+    fflush(stdout);
+    hiers[i].finish();
+  }
+
+  fprintf(stderr, "Replayed %" PRIu64 " accesses from %zu hart(s) through %zu "
+          "configuration(s) in %.2f s (%.1f M accesses/s overall)\n",
+          records, nharts, hiers.size(), elapsed.count(),
+          records * hiers.size() / elapsed.count() / 1e6);
+
+  munmap((void*)data, size);
+  return 0;
+}
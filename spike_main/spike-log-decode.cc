@@ -0,0 +1,155 @@
+// See LICENSE for license details.
+
+// Expands a binary commit log written with spike --commit-log=<file> into
+// the text commit log format that spike prints to stderr.
+
+#include "commit_log.h"
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <vector>
+#include <fesvr/option_parser.h>
+
+static void help()
+{
+  fprintf(stderr, "usage: spike-log-decode [--hart=<n>] [<log file>]\n");
+  fprintf(stderr, "Reads standard input if no file is given.\n");
+  exit(1);
+}
+
+static void print_value(FILE* out, int width, uint64_t hi, uint64_t lo)
+{
+  switch (width) {
+    case 16:
+      fprintf(out, "0x%04" PRIx16, (uint16_t)lo);
+      break;
+    case 32:
+      fprintf(out, "0x%08" PRIx32, (uint32_t)lo);
+      break;
+    case 64:
+      fprintf(out, "0x%016" PRIx64, lo);
+      break;
+    case 128:
+      fprintf(out, "0x%016" PRIx64 "%016" PRIx64, hi, lo);
+      break;
+    default:
+      fprintf(out, "0x%0*" PRIx64, width / 4, lo);
+      break;
+  }
+}
+
+static void truncated()
+{
+  fprintf(stderr, "spike-log-decode: truncated commit log\n");
+  exit(1);
+}
+
+static uint64_t get(const uint8_t*& p, const uint8_t* end, int bytes)
+{
+  if (end - p < bytes)
+    truncated();
+  uint64_t x = 0;
+  for (int i = 0; i < bytes; i++)
+    x |= uint64_t(*p++) << (8 * i);
+  return x;
+}
+
+static void decode_chunk(FILE* out, const uint8_t* p, const uint8_t* end,
+                         uint64_t& next_pc)
+{
+  while (p < end) {
+    uint8_t flags = *p++;
+    int priv = flags & COMMIT_LOG_PRIV_MASK;
+    int xlen = 32 << ((flags >> COMMIT_LOG_XLEN_SHIFT) & 3);
+    int flen_code = (flags >> COMMIT_LOG_FLEN_SHIFT) & 3;
+    int flen = flen_code ? 16 << flen_code : 0;
+
+    uint64_t zz = 0;
+    for (int shift = 0; ; shift += 7) {
+      if (p == end || shift > 63)
+        truncated();
+      uint8_t b = *p++;
+      zz |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+    uint64_t pc = next_pc + ((zz >> 1) ^ -(zz & 1));
+
+    if (end - p < 2)
+      truncated();
+    int len = insn_length(p[0]);
+    uint64_t insn = get(p, end, len);
+    next_pc = pc + len;
+
+    int rd = 0, size = 0;
+    uint64_t lo = 0, hi = 0;
+    if (flags & COMMIT_LOG_WRITE) {
+      rd = get(p, end, 1);
+      size = rd & 1 ? flen : xlen;
+      lo = get(p, end, size > 64 ? 8 : size / 8);
+      hi = size > 64 ? get(p, end, (size - 64) / 8) : 0;
+    }
+
+    if (!out)
+      continue;
+    fprintf(out, "%1d ", priv);
+    print_value(out, xlen, 0, pc);
+    fprintf(out, " (");
+    print_value(out, len * 8, 0, insn);
+    if (flags & COMMIT_LOG_WRITE) {
+      fprintf(out, ") %c%2d ", rd & 1 ? 'f' : 'x', rd >> 1);
+      print_value(out, size, hi, lo);
+      fprintf(out, "\n");
+    } else {
+      fprintf(out, ")\n");
+    }
+  }
+}
+
+int main(int argc, char** argv)
+{
+  long hart = -1;
+
+  option_parser_t parser;
+  parser.help(&help);
+  parser.option('h', 0, 0, [&](const char* s){help();});
+  parser.option(0, "hart", 1, [&](const char* s){hart = atol(s);});
+  auto argv1 = parser.parse(argv);
+
+  FILE* in = stdin;
+  if (*argv1 && !(in = fopen(*argv1, "rb"))) {
+    fprintf(stderr, "spike-log-decode: unable to open '%s'\n", *argv1);
+    return 1;
+  }
+
+  char magic[COMMIT_LOG_MAGIC_SIZE];
+  if (fread(magic, 1, sizeof(magic), in) != sizeof(magic) ||
+      memcmp(magic, COMMIT_LOG_MAGIC, sizeof(magic)) != 0) {
+    fprintf(stderr, "spike-log-decode: not a spike commit log\n");
+    return 1;
+  }
+
+  // Records are PC-delta encoded per hart, so keep each hart's position
+  // across its chunks.
+  std::map<uint32_t, uint64_t> next_pc;
+  std::vector<uint8_t> chunk;
+  uint8_t header[8];
+  size_t n;
+  while ((n = fread(header, 1, sizeof(header), in)) == sizeof(header)) {
+    const uint8_t* h = header;
+    uint32_t id = get(h, header + 8, 4);
+    uint32_t size = get(h, header + 8, 4);
+    chunk.resize(size);
+    if (fread(chunk.data(), 1, size, in) != size)
+      truncated();
+    uint64_t& pc = next_pc[id];
+    decode_chunk(hart < 0 || hart == long(id) ? stdout : NULL,
+                 chunk.data(), chunk.data() + size, pc);
+  }
+  if (n != 0)
+    truncated();
+
+  return 0;
+}
@@ -0,0 +1,194 @@
+// See LICENSE for license details.
+
+// Stands in for a memory blade shared by several simulators: keeps remote
+// pages for every spike started with --memblade-server=<name>, serving each
+// through its own channel of the shared memory object <name> (see
+// memblade_shm.h).  Statistics are written to stderr on exit.
+
+#include "memblade_shm.h"
+#include "file_store.h"
+#include "page_store.h"
+#include "stats.h"
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fesvr/option_parser.h>
+
+static void help()
+{
+  fprintf(stderr, "usage: spike-memblade-server [options] <name>\n");
+  fprintf(stderr, "Serve remote pages to simulators run with --memblade-server=<name>\n");
+  fprintf(stderr, "through the POSIX shared memory object <name> (e.g. /blade0).\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --remote-mem=<file>   Keep pages in a sparse file, kept across runs,\n");
+  fprintf(stderr, "                          instead of host memory\n");
+  fprintf(stderr, "  --zero-pages          Keep all-zero pages as a flag, without data\n");
+  fprintf(stderr, "  --compress            LZ-compress pages in host memory\n");
+  exit(1);
+}
+
+static volatile sig_atomic_t done = 0;
+static void handle_signal(int sig)
+{
+  done = 1;
+}
+
+// Gives a channel back to the simulators that come after its owner.
+static void release(mbshm_channel_t& c)
+{
+  c.pid = 0;
+  c.state.store(MBSHM_FREE, std::memory_order_release);
+}
+
+int main(int argc, char** argv)
+{
+  const char* remote_mem = NULL;
+  bool zero_pages = false, compress = false;
+
+  option_parser_t parser;
+  parser.help(&help);
+  parser.option(0, "remote-mem", 1, [&](const char* s){remote_mem = s;});
+  parser.option(0, "zero-pages", 0, [&](const char* s){zero_pages = true;});
+  parser.option(0, "compress", 0, [&](const char* s){compress = true;});
+  auto argv1 = parser.parse(argv);
+  if (!argv1[0] || argv1[1])
+    help();
+  const char* name = argv1[0];
+
+  std::unique_ptr<remote_store_t> store;
+  if (remote_mem) {
+    store.reset(new file_store_t(remote_mem));
+  } else {
+    page_store_t* ps = new page_store_t;
+    ps->set_zero_pages(zero_pages);
+    ps->set_compression(compress);
+    store.reset(ps);
+  }
+
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    fprintf(stderr, "can't create %s: %s\n", name, strerror(errno));
+    exit(1);
+  }
+  if (ftruncate(fd, sizeof(mbshm_region_t)) < 0) {
+    fprintf(stderr, "can't size %s: %s\n", name, strerror(errno));
+    shm_unlink(name);
+    exit(1);
+  }
+  void* p = mmap(NULL, sizeof(mbshm_region_t), PROT_READ | PROT_WRITE,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "can't map %s: %s\n", name, strerror(errno));
+    shm_unlink(name);
+    exit(1);
+  }
+  mbshm_region_t* region = (mbshm_region_t*)p;
+  region->pid = getpid();
+  region->magic.store(MBSHM_MAGIC, std::memory_order_release);
+
+  signal(SIGINT, &handle_signal);
+  signal(SIGTERM, &handle_signal);
+
+  uint64_t requests[MBSHM_ERASE + 1] = {0};
+  uint64_t idle = 0;
+  auto last_reclaim = std::chrono::steady_clock::now();
+  bool claimed[MBSHM_CLIENTS] = {false}; // at the last reclaim
+  while (!done) {
+    bool busy = false;
+    for (size_t i = 0; i < MBSHM_CLIENTS; i++) {
+      mbshm_channel_t& c = region->channels[i];
+      if (c.state.load(std::memory_order_acquire) != MBSHM_ACTIVE)
+        continue;
+
+      // A simulator whose request ring makes no sense is cut off, so it
+      // can't have garbage served forever.
+      uint32_t queued = c.req.head.load(std::memory_order_acquire) -
+                        c.req.tail.load(std::memory_order_relaxed);
+      if (queued > MBSHM_RING) {
+        fprintf(stderr, "spike-memblade-server: dropping channel %zu of pid %d: "
+                "its request ring is corrupt\n", i, (int)c.pid);
+        release(c);
+        continue;
+      }
+
+      // Serve what was queued when the pass began, so that no channel
+      // starves the others, and only while its answers have room.
+      mbshm_desc_t d;
+      for (; queued > 0; queued--) {
+        if (c.resp.head.load(std::memory_order_relaxed) -
+            c.resp.tail.load(std::memory_order_acquire) >= MBSHM_RING)
+          break;
+        mbshm_pop(c.req, d);
+        busy = true;
+        // a confused simulator must not reach outside its own channel
+        if (d.buf >= MBSHM_RING) {
+          d.ok = 0;
+          d.pages = store->size();
+          mbshm_push(c.resp, d);
+          continue;
+        }
+        switch (d.op) {
+          case MBSHM_READ: d.ok = store->read(d.key, c.pages[d.buf]); break;
+          case MBSHM_WRITE: d.ok = store->write(d.key, c.pages[d.buf]); break;
+          case MBSHM_CONTAINS: d.ok = store->contains(d.key); break;
+          case MBSHM_ERASE: d.ok = store->erase(d.key); break;
+          default: d.ok = 0; break;
+        }
+        if (d.op <= MBSHM_ERASE)
+          requests[d.op]++;
+        d.pages = store->size();
+        mbshm_push(c.resp, d);
+      }
+    }
+
+    // Free the channels of simulators that died without releasing them,
+    // however busy the others keep the server. One that died while claiming
+    // a channel may not have recorded its pid, so a channel claimed at two
+    // checks in a row goes unless its pid is alive.
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_reclaim >= std::chrono::seconds(1)) {
+      last_reclaim = now;
+      for (size_t i = 0; i < MBSHM_CLIENTS; i++) {
+        mbshm_channel_t& c = region->channels[i];
+        uint32_t state = c.state.load(std::memory_order_acquire);
+        bool stuck = state == MBSHM_CLAIMED && claimed[i];
+        claimed[i] = state == MBSHM_CLAIMED;
+        if ((state == MBSHM_ACTIVE || stuck) &&
+            (c.pid == 0 || (kill(c.pid, 0) < 0 && errno == ESRCH))) {
+          claimed[i] = false;
+          release(c);
+        }
+      }
+    }
+
+    // Spin while simulators are busy, but stop burning a CPU once they go
+    // quiet.
+    if (busy)
+      idle = 0;
+    else if (++idle < 100000)
+      sched_yield();
+    else
+      usleep(1000);
+  }
+
+  shm_unlink(name);
+
+  stats_writer_t w(stderr);
+  w.add("reads", requests[MBSHM_READ]);
+  w.add("writes", requests[MBSHM_WRITE]);
+  w.add("contains", requests[MBSHM_CONTAINS]);
+  w.add("erases", requests[MBSHM_ERASE]);
+  w.begin("store");
+  store->dump_stats(w);
+  w.end();
+  return 0;
+}
@@ -4,6 +4,10 @@
 #include "mmu.h"
 #include "remote_bitbang.h"
 #include "cachesim.h"
+#include "stackdist.h"
+#include "tlbsim.h"
+#include "timing.h"
+#include "memtrace.h"
 #include "extension.h"
 #include <dlfcn.h>
 #include <fesvr/option_parser.h>
@@ -23,15 +27,65 @@ static void help()
   fprintf(stderr, "                          at base addresses a and b (with 4 KiB alignment)\n");
   fprintf(stderr, "  -d                    Interactive debug mode\n");
   fprintf(stderr, "  -g                    Track histogram of PCs\n");
+  fprintf(stderr, "  --histogram-out=<p>   Write the -g profile to <p>.<hart>.func and\n");
+  fprintf(stderr, "                          per-PC counts to <p>.<hart>.pc\n");
+  fprintf(stderr, "  --symbols=<elf>       Also symbolize profiles with <elf>'s symbols\n");
+  fprintf(stderr, "  --bbv=<N>:<file>      Write SimPoint basic-block vectors for every\n");
+  fprintf(stderr, "                          N instructions to <file> (.<hart> per hart)\n");
+  fprintf(stderr, "  --callgraph=<p>       Write guest call stacks in flamegraph.pl's\n");
+  fprintf(stderr, "                          folded format to <p>.<hart>.<U|S|M>.folded\n");
   fprintf(stderr, "  -l                    Generate a log of execution\n");
+  fprintf(stderr, "  --commit-log=<file>   Write the commit log in binary form to <file>;\n");
+  fprintf(stderr, "                          expand it with spike-log-decode\n");
   fprintf(stderr, "  -h                    Print this help message\n");
   fprintf(stderr, "  -H                    Start halted, allowing a debugger to connect\n");
   fprintf(stderr, "  --isa=<name>          RISC-V ISA string [default %s]\n", DEFAULT_ISA);
   fprintf(stderr, "  --pc=<address>        Override ELF entry point\n");
   fprintf(stderr, "  --hartids=<a,b,...>   Explicitly specify hartids, default is 0,1,...\n");
-  fprintf(stderr, "  --ic=<S>:<W>:<B>      Instantiate a cache model with S sets,\n");
-  fprintf(stderr, "  --dc=<S>:<W>:<B>        W ways, and B-byte blocks (with S and\n");
-  fprintf(stderr, "  --l2=<S>:<W>:<B>        B both powers of 2).\n");
+  fprintf(stderr, "  --ic=<S>:<W>:<B>[:<P>] Instantiate a cache model with S sets,\n");
+  fprintf(stderr, "  --dc=<S>:<W>:<B>[:<P>]   W ways, and B-byte blocks (with S and\n");
+  fprintf(stderr, "  --l2=<S>:<W>:<B>[:<P>]   B both powers of 2), replacing with policy\n");
+  fprintf(stderr, "                          P: random [default], lru, plru, or srrip\n");
+  fprintf(stderr, "                          and optionally prefetching with a further\n");
+  fprintf(stderr, "                          :<F>, F being nextline, stride, or stream\n");
+  fprintf(stderr, "  --itlb=<S>:<W>         Model target TLBs with S sets and W ways:\n");
+  fprintf(stderr, "  --dtlb=<S>:<W>           L1 instruction and data TLBs and a unified\n");
+  fprintf(stderr, "  --l2tlb=<S>:<W>          L2 TLB; page walks read through the D$\n");
+  fprintf(stderr, "  --stack-dist=<S>:<W>:<B> Report LRU data-cache miss rates for every\n");
+  fprintf(stderr, "                          power-of-2 set count up to S and up to W ways\n");
+  fprintf(stderr, "                          with B-byte blocks, in a single run\n");
+  fprintf(stderr, "  --mem-trace=<file>    Record all harts' memory accesses to <file>\n");
+  fprintf(stderr, "                          for replay with spike-cache-replay\n");
+  fprintf(stderr, "  --timing              Estimate mcycle from instruction, branch and\n");
+  fprintf(stderr, "                          cache-miss latencies rather than minstret\n");
+  fprintf(stderr, "  --latency=<name>=<n>,... Set the --timing latencies (implies\n");
+  fprintf(stderr, "                          --timing): mul, div, fp, fdiv, branch,\n");
+  fprintf(stderr, "                          l1-miss, l2-miss\n");
+  fprintf(stderr, "  --pfa=<name>=<n>,...  Model the PFA's link to the memory blade:\n");
+  fprintf(stderr, "                          evict-latency (instructions) and\n");
+  fprintf(stderr, "                          evict-bandwidth (bytes per instruction);\n");
+  fprintf(stderr, "                          fetch-latency (cycles) and fetch-bandwidth\n");
+  fprintf(stderr, "                          (bytes per cycle), for which the faulting\n");
+  fprintf(stderr, "                          hart stalls (as does mcycle with --timing);\n");
+  fprintf(stderr, "                          zero-pages=1 and compress=1 shrink the host\n");
+  fprintf(stderr, "                          memory that holds remote pages;\n");
+  fprintf(stderr, "                          prefetch=<k> fetches k more pages along\n");
+  fprintf(stderr, "                          the faulting stream with each fault;\n");
+  fprintf(stderr, "                          page-stats=1 tracks every remote page\n");
+  fprintf(stderr, "                          for the refetch statistics\n");
+  fprintf(stderr, "  --remote-mem=<file>   Keep PFA and memory blade remote pages in\n");
+  fprintf(stderr, "                          a sparse file, kept across runs, instead\n");
+  fprintf(stderr, "                          of host memory\n");
+  fprintf(stderr, "  --memblade-server=<name>  Keep them in the spike-memblade-server\n");
+  fprintf(stderr, "                          serving shared memory object <name>,\n");
+  fprintf(stderr, "                          along with other simulators' pages\n");
+  fprintf(stderr, "  --stats-interval=<n>  Dump all statistics as a line of JSON every\n");
+  fprintf(stderr, "                          <n> instructions and at exit; SIGUSR1\n");
+  fprintf(stderr, "                          also dumps them at any time\n");
+  fprintf(stderr, "  --stats-out=<file>    Write statistics dumps to <file> [default stderr]\n");
+  fprintf(stderr, "  --fast-forward=<n>    Attach cache models only after <n> instructions\n");
+  fprintf(stderr, "  --warmup=<n>          Then warm caches for <n> instructions before\n");
+  fprintf(stderr, "                          collecting cache statistics\n");
   fprintf(stderr, "  --extension=<name>    Specify RoCC Extension\n");
   fprintf(stderr, "  --extlib=<name>       Shared library to load\n");
   fprintf(stderr, "  --rbb-port=<port>     Listen on <port> for remote bitbang connection\n");
@@ -79,6 +133,12 @@ int main(int argc, char** argv)
   bool debug = false;
   bool halted = false;
   bool histogram = false;
+  const char* histogram_out = NULL;
+  std::vector<const char*> symbol_files;
+  uint64_t bbv_interval = 0;
+  const char* bbv_file = NULL;
+  const char* callgraph = NULL;
+  const char* commit_log = NULL;
   bool log = false;
   bool dump_dts = false;
   size_t nprocs = 1;
@@ -87,6 +147,21 @@ int main(int argc, char** argv)
   std::unique_ptr<icache_sim_t> ic;
   std::unique_ptr<dcache_sim_t> dc;
   std::unique_ptr<cache_sim_t> l2;
+  const char* itlb = NULL;
+  const char* dtlb = NULL;
+  const char* l2tlb = NULL;
+  std::unique_ptr<stack_dist_sim_t> stack_dist;
+  bool timing = false;
+  timing_config_t timing_config;
+  std::unique_ptr<mem_trace_writer_t> mem_trace;
+  pfa_config_t pfa_config;
+  const char* remote_mem = NULL;
+  const char* memblade_server = NULL;
+  bool stats = false;
+  uint64_t stats_interval = 0;
+  const char* stats_out = NULL;
+  uint64_t fast_forward = 0;
+  uint64_t warmup = 0;
   std::function<extension_t*()> extension;
   const char* isa = DEFAULT_ISA;
   uint16_t rbb_port = 0;
@@ -113,6 +188,17 @@ int main(int argc, char** argv)
   parser.option('h', 0, 0, [&](const char* s){help();});
   parser.option('d', 0, 0, [&](const char* s){debug = true;});
   parser.option('g', 0, 0, [&](const char* s){histogram = true;});
+  parser.option(0, "histogram-out", 1, [&](const char* s){histogram_out = s;});
+  parser.option(0, "symbols", 1, [&](const char* s){symbol_files.push_back(s);});
+  parser.option(0, "bbv", 1, [&](const char* s){
+    char* p;
+    bbv_interval = strtoull(s, &p, 0);
+    if (*p != ':' || !p[1] || bbv_interval == 0)
+      help();
+    bbv_file = p + 1;
+  });
+  parser.option(0, "callgraph", 1, [&](const char* s){callgraph = s;});
+  parser.option(0, "commit-log", 1, [&](const char* s){commit_log = s;});
   parser.option('l', 0, 0, [&](const char* s){log = true;});
   parser.option('p', 0, 1, [&](const char* s){nprocs = atoi(s);});
   parser.option('m', 0, 1, [&](const char* s){mems = make_mems(s);});
@@ -124,6 +210,26 @@ int main(int argc, char** argv)
   parser.option(0, "ic", 1, [&](const char* s){ic.reset(new icache_sim_t(s));});
   parser.option(0, "dc", 1, [&](const char* s){dc.reset(new dcache_sim_t(s));});
   parser.option(0, "l2", 1, [&](const char* s){l2.reset(cache_sim_t::construct(s, "L2$"));});
+  parser.option(0, "itlb", 1, [&](const char* s){itlb = s;});
+  parser.option(0, "dtlb", 1, [&](const char* s){dtlb = s;});
+  parser.option(0, "l2tlb", 1, [&](const char* s){l2tlb = s;});
+  parser.option(0, "timing", 0, [&](const char* s){timing = true;});
+  parser.option(0, "latency", 1, [&](const char* s){
+    timing = true;
+    timing_config.parse(s);
+  });
+  parser.option(0, "stack-dist", 1, [&](const char* s){stack_dist.reset(new stack_dist_sim_t(s));});
+  parser.option(0, "mem-trace", 1, [&](const char* s){mem_trace.reset(new mem_trace_writer_t(s));});
+  parser.option(0, "pfa", 1, [&](const char* s){pfa_config.parse(s);});
+  parser.option(0, "remote-mem", 1, [&](const char* s){remote_mem = s;});
+  parser.option(0, "memblade-server", 1, [&](const char* s){memblade_server = s;});
+  parser.option(0, "stats-interval", 1, [&](const char* s){
+    stats = true;
+    stats_interval = strtoull(s, 0, 0);
+  });
+  parser.option(0, "stats-out", 1, [&](const char* s){stats = true; stats_out = s;});
+  parser.option(0, "fast-forward", 1, [&](const char* s){fast_forward = strtoull(s, 0, 0);});
+  parser.option(0, "warmup", 1, [&](const char* s){warmup = strtoull(s, 0, 0);});
   parser.option(0, "isa", 1, [&](const char* s){isa = s;});
   parser.option(0, "extension", 1, [&](const char* s){extension = find_extension(s);});
   parser.option(0, "dump-dts", 0, [&](const char *s){dump_dts = true;});
@@ -142,6 +248,10 @@ int main(int argc, char** argv)
 
   auto argv1 = parser.parse(argv);
   std::vector<std::string> htif_args(argv1, (const char*const*)argv + argc);
+  if (remote_mem && memblade_server) {
+    fprintf(stderr, "--remote-mem and --memblade-server can't be used together\n");
+    exit(1);
+  }
   if (mems.empty())
     mems = make_mems("2048");
 
@@ -162,17 +272,129 @@ int main(int argc, char** argv)
   if (!*argv1)
     help();
 
+  s.get_pfa()->set_config(pfa_config);
+  if (remote_mem)
+    s.set_remote_mem(remote_mem);
+  if (memblade_server)
+    s.set_memblade_server(memblade_server);
+
   if (ic && l2) ic->set_miss_handler(&*l2);
   if (dc && l2) dc->set_miss_handler(&*l2);
+  if (timing) {
+    if (ic) ic->get_cache()->set_miss_penalty(timing_config.l1_miss);
+    if (dc) dc->get_cache()->set_miss_penalty(timing_config.l1_miss);
+    if (l2) l2->set_miss_penalty(timing_config.l2_miss);
+  }
   for (size_t i = 0; i < nprocs; i++)
   {
-    if (ic) s.get_core(i)->get_mmu()->register_memtracer(&*ic);
-    if (dc) s.get_core(i)->get_mmu()->register_memtracer(&*dc);
     if (extension) s.get_core(i)->register_extension(extension());
+    if (timing) s.get_core(i)->set_timing(timing_config);
   }
 
+  // Every hart gets private L1s cloned from the --ic/--dc models.  With
+  // more than one hart they share the L2 and are kept coherent by a bus.
+  coherence_bus_t bus;
+  std::vector<std::unique_ptr<icache_sim_t>> ics;
+  std::vector<std::unique_ptr<dcache_sim_t>> dcs;
+  std::vector<std::unique_ptr<mem_trace_capture_t>> mem_tracers;
+  std::vector<std::unique_ptr<tlb_sim_t>> tlbs;
+  std::unique_ptr<tlb_sim_t> tlb;
+  if (itlb || dtlb || l2tlb)
+    tlb.reset(new tlb_sim_t(itlb, dtlb, l2tlb));
+  for (size_t i = 0; i < nprocs; i++)
+  {
+    if (mem_trace)
+      mem_tracers.emplace_back(new mem_trace_capture_t(&*mem_trace, i));
+    std::string suffix = nprocs > 1 ? std::to_string(i) : "";
+    uint64_t* stalls = timing ? s.get_core(i)->get_timing()->memory_stall_counter() : NULL;
+    if (ic) {
+      ics.emplace_back(new icache_sim_t(*ic));
+      ics.back()->set_name("I$" + suffix);
+      ics.back()->set_stall_counter(stalls);
+      if (nprocs > 1) ics.back()->set_coherence_bus(&bus);
+    }
+    if (dc) {
+      dcs.emplace_back(new dcache_sim_t(*dc));
+      dcs.back()->set_name("D$" + suffix);
+      dcs.back()->set_stall_counter(stalls);
+      if (nprocs > 1) dcs.back()->set_coherence_bus(&bus);
+    }
+    // page walks read through this hart's D$, or the L2 without one
+    if (tlb) {
+      tlbs.emplace_back(new tlb_sim_t(*tlb));
+      tlbs.back()->set_name_suffix(suffix);
+      tlbs.back()->set_mmu(s.get_core(i)->get_mmu());
+      tlbs.back()->set_walk_cache(dc ? dcs.back()->get_cache() : l2.get());
+      tlbs.back()->set_stall_counter(stalls);
+    }
+  }
+  tlb.reset();
+
+  for (size_t i = 0; i < nprocs; i++)
+  {
+    if (ic) {
+      cache_sim_t* c = ics[i]->get_cache();
+      s.get_stats().add(c->get_name(), [c](stats_writer_t& w) { c->dump_stats(w); });
+    }
+    if (dc) {
+      cache_sim_t* c = dcs[i]->get_cache();
+      s.get_stats().add(c->get_name(), [c](stats_writer_t& w) { c->dump_stats(w); });
+    }
+    if (!tlbs.empty()) {
+      tlb_sim_t* t = tlbs[i].get();
+      std::string name = "TLB" + (nprocs > 1 ? std::to_string(i) : std::string());
+      s.get_stats().add(name, [t](stats_writer_t& w) { t->dump_stats(w); });
+    }
+  }
+  if (l2) {
+    cache_sim_t* c = l2.get();
+    s.get_stats().add(c->get_name(), [c](stats_writer_t& w) { c->dump_stats(w); });
+  }
+
+  // The cache models are only attached once the fast-forward point is
+  // reached, so the skipped region runs on the untraced fast path.
+  auto attach_caches = [&]() {
+    for (size_t i = 0; i < nprocs; i++)
+    {
+      if (!tlbs.empty()) s.get_core(i)->get_mmu()->register_memtracer(&*tlbs[i]);
+      if (ic) s.get_core(i)->get_mmu()->register_memtracer(&*ics[i]);
+      if (dc) s.get_core(i)->get_mmu()->register_memtracer(&*dcs[i]);
+      if (stack_dist) s.get_core(i)->get_mmu()->register_memtracer(&*stack_dist);
+      if (mem_trace) s.get_core(i)->get_mmu()->register_memtracer(&*mem_tracers[i]);
+    }
+  };
+  auto reset_cache_stats = [&]() {
+    for (auto& c : ics) c->reset_stats();
+    for (auto& c : dcs) c->reset_stats();
+    for (auto& t : tlbs) t->reset_stats();
+    if (l2) l2->reset_stats();
+    if (stack_dist) stack_dist->reset_stats();
+  };
+  s.set_fast_forward(fast_forward, warmup, attach_caches, reset_cache_stats);
+
   s.set_debug(debug);
   s.set_log(log);
   s.set_histogram(histogram);
+  if (histogram || callgraph) {
+    // the target program is the first argument that isn't an htif +option
+    for (auto& arg : htif_args) {
+      if (arg[0] != '+') {
+        symbol_files.insert(symbol_files.begin(), arg.c_str());
+        break;
+      }
+    }
+    for (auto file : symbol_files)
+      if (!s.load_symbols(file))
+        fprintf(stderr, "warning: no symbols loaded from '%s'\n", file);
+    s.set_histogram_output(histogram_out);
+  }
+  if (bbv_file)
+    s.set_bbv(bbv_file, bbv_interval);
+  if (callgraph)
+    s.set_callgraph(callgraph);
+  if (commit_log)
+    s.set_commit_log(commit_log);
+  if (stats)
+    s.set_stats_output(stats_out, stats_interval);
   return s.run();
 }
@@ -0,0 +1,20 @@
+#!/usr/bin/python
+
+import testlib
+import unittest
+
+class PfaBatchTest(unittest.TestCase):
+    def setUp(self):
+        self.binary = testlib.compile("pfa_batch.s", "-nostdlib",
+                "-nostartfiles", "-Wl,-Ttext=0x80000000")
+
+    def test_batch(self):
+        """Make sure batched evictions and free frames and the new page ring
+        work, and that batches and rings that don't fit are refused."""
+        spike = testlib.Spike(self.binary, with_gdb=False, timeout=10,
+                args=["-m64"], pk=False)
+        result = spike.wait()
+        self.assertEqual(result, 0)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,285 @@
+# Batched PFA queue management (run with -m64).  The hart evicts its pages
+# with one EVICT_BATCH and gives the PFA frames with one FREE_BATCH, after
+# checking that batches that don't fit or aren't in memory are refused, and
+# that a new page ring whose size isn't a power of two or which runs off the
+# end of memory is refused.  It then faults on its pages from S-mode with a
+# good ring installed and checks the ring holds exactly those pages.
+#
+# Exits with 0 on success, 1 on failure.
+
+        .equ    PFA_BASE, 0x10017000
+        .equ    PFA_FREESTAT, 8
+        .equ    PFA_EVICTSTAT, 24
+        .equ    PFA_NEWSTAT, 48
+        .equ    PFA_BATCHADDR, 64
+        .equ    PFA_EVICTBATCH, 72
+        .equ    PFA_FREEBATCH, 80
+        .equ    PFA_NEWRING, 88
+        .equ    PFA_EVICT_MAX, 256
+        .equ    PFA_FREE_MAX, 256
+
+        .equ    MEM_END, 0x84000000
+        .equ    NOT_MEM, 0x20000000
+        .equ    NPAGES, 4
+        .equ    RING_SIZE, 4
+        .equ    REMOTE_VA, 0x40000000
+        .equ    FIRST_RPN, 100
+        .equ    PATTERN, 0x0101010101010101
+
+        .text
+        .global _start
+_start:
+        la      t0, trap
+        csrw    mtvec, t0
+        li      s1, PFA_BASE
+        li      s5, 0           # set while a store is expected to fault
+
+        # Fill page i with (i + 1) * PATTERN and list its eviction to
+        # FIRST_RPN + i
+        la      t0, pages
+        la      t5, batch
+        li      t1, 0
+fill_page:
+        addi    t2, t1, 1
+        li      t3, PATTERN
+        mul     t2, t2, t3
+        mv      t4, t0
+        li      t3, 512
+fill_word:
+        sd      t2, 0(t4)
+        addi    t4, t4, 8
+        addi    t3, t3, -1
+        bnez    t3, fill_word
+        addi    t2, t1, FIRST_RPN
+        slli    t2, t2, 36
+        srli    t3, t0, 12
+        or      t2, t2, t3
+        sd      t2, 0(t5)
+        addi    t5, t5, 8
+        li      t3, 4096
+        add     t0, t0, t3
+        addi    t1, t1, 1
+        li      t3, NPAGES
+        bne     t1, t3, fill_page
+
+        # A batch that isn't in memory is refused
+        li      t0, NOT_MEM
+        sd      t0, PFA_BATCHADDR(s1)
+        li      t0, NPAGES
+        li      s5, 1
+        sd      t0, PFA_EVICTBATCH(s1)
+        bnez    s5, fail
+
+        la      t0, batch
+        sd      t0, PFA_BATCHADDR(s1)
+        ld      t1, PFA_BATCHADDR(s1)
+        bne     t0, t1, fail
+
+        # So is one with more pages than the evict queue has room for
+        li      t0, PFA_EVICT_MAX + 1
+        li      s5, 1
+        sd      t0, PFA_EVICTBATCH(s1)
+        bnez    s5, fail
+        ld      t0, PFA_EVICTSTAT(s1)
+        li      t1, PFA_EVICT_MAX
+        bne     t0, t1, fail
+
+        li      t0, NPAGES
+        sd      t0, PFA_EVICTBATCH(s1)
+        li      t1, PFA_EVICT_MAX
+evict_poll:
+        ld      t0, PFA_EVICTSTAT(s1)
+        bne     t0, t1, evict_poll
+
+        # Clear the frames so the data can only come from remote memory
+        la      t0, pages
+        li      t1, NPAGES * 512
+clear:
+        sd      zero, 0(t0)
+        addi    t0, t0, 8
+        addi    t1, t1, -1
+        bnez    t1, clear
+
+        # One free frame per page, in one batch
+        la      t0, frames
+        la      t1, batch
+        li      t2, NPAGES
+list_frame:
+        sd      t0, 0(t1)
+        li      t3, 4096
+        add     t0, t0, t3
+        addi    t1, t1, 8
+        addi    t2, t2, -1
+        bnez    t2, list_frame
+
+        li      t0, NPAGES
+        sd      t0, PFA_FREEBATCH(s1)
+        ld      t0, PFA_FREESTAT(s1)
+        li      t1, PFA_FREE_MAX - NPAGES
+        bne     t0, t1, fail
+        li      t0, PFA_FREE_MAX - NPAGES + 1
+        li      s5, 1
+        sd      t0, PFA_FREEBATCH(s1)
+        bnez    s5, fail
+        ld      t0, PFA_FREESTAT(s1)
+        li      t1, PFA_FREE_MAX - NPAGES
+        bne     t0, t1, fail
+
+        # A ring whose size isn't a power of two is refused
+        la      t0, ring
+        li      t1, 3
+        sd      t1, 16(t0)
+        li      s5, 1
+        sd      t0, PFA_NEWRING(s1)
+        bnez    s5, fail
+
+        # So is one that runs off the end of memory
+        li      t0, MEM_END - 32
+        sd      zero, 0(t0)
+        sd      zero, 8(t0)
+        li      t1, RING_SIZE
+        sd      t1, 16(t0)
+        li      s5, 1
+        sd      t0, PFA_NEWRING(s1)
+        bnez    s5, fail
+
+        la      t0, ring
+        li      t1, RING_SIZE
+        sd      t1, 16(t0)
+        sd      t0, PFA_NEWRING(s1)
+
+        # root[1] -> l1, l1[0] -> l0, root[2] maps 0x80000000 as a gigapage
+        la      t0, pt_root
+        la      t1, pt_l1
+        srli    t1, t1, 12
+        slli    t1, t1, 10
+        ori     t1, t1, 0x1
+        sd      t1, 8(t0)
+        li      t1, (0x80000000 >> 12) << 10 | 0xcf
+        sd      t1, 16(t0)
+        la      t0, pt_l1
+        la      t1, pt_l0
+        srli    t1, t1, 12
+        slli    t1, t1, 10
+        ori     t1, t1, 0x1
+        sd      t1, 0(t0)
+
+        # l0[i] is remote: page ID FIRST_RPN + i, protection V|R|W|A|D
+        la      t0, pt_l0
+        li      t1, 0
+remote_pte:
+        addi    t2, t1, FIRST_RPN
+        slli    t2, t2, 12
+        ori     t2, t2, (0xc7 << 2) | 0x2
+        sd      t2, 0(t0)
+        addi    t0, t0, 8
+        addi    t1, t1, 1
+        li      t3, NPAGES
+        bne     t1, t3, remote_pte
+
+        # Enter S-mode with the page table
+        la      t0, pt_root
+        srli    t0, t0, 12
+        li      t1, 8 << 60
+        or      t0, t0, t1
+        csrw    satp, t0
+        sfence.vma
+        li      t0, 0x1800
+        csrc    mstatus, t0
+        li      t0, 0x800
+        csrs    mstatus, t0
+        la      t0, s_entry
+        csrw    mepc, t0
+        mret
+
+        # Sum the first word of every page into a0
+s_entry:
+        li      s2, REMOTE_VA
+        li      t1, NPAGES
+        li      a0, 0
+scan:
+        ld      t0, 0(s2)
+        add     a0, a0, t0
+        li      t0, 4096
+        add     s2, s2, t0
+        addi    t1, t1, -1
+        bnez    t1, scan
+        ecall
+
+        .align  2               # mtvec ignores the low two bits
+trap:
+        csrr    t0, mcause
+        li      t1, 9           # ecall from S-mode
+        beq     t0, t1, check
+
+        # An expected store access fault: skip the (4-byte) store
+        li      t1, 7
+        bne     t0, t1, fail
+        beqz    s5, fail
+        li      s5, 0
+        csrr    t0, mepc
+        addi    t0, t0, 4
+        csrw    mepc, t0
+        mret
+
+check:
+        # 1 + 2 + ... + NPAGES times PATTERN
+        li      t0, NPAGES * (NPAGES + 1) / 2
+        li      t1, PATTERN
+        mul     t0, t0, t1
+        bne     a0, t0, fail
+
+        # The ring, not the queues, holds every page in address order
+        ld      t0, PFA_NEWSTAT(s1)
+        li      t1, NPAGES
+        bne     t0, t1, fail
+        la      s3, ring
+        ld      t0, 0(s3)
+        bne     t0, t1, fail
+        ld      t0, 8(s3)
+        bnez    t0, fail
+        addi    s3, s3, 32
+        li      s4, 0           # page
+ring_record:
+        ld      t0, 0(s3)
+        ld      t1, 8(s3)
+        addi    t2, s4, FIRST_RPN
+        bne     t0, t2, fail
+        slli    t2, s4, 12
+        li      t3, REMOTE_VA
+        add     t2, t2, t3
+        bne     t1, t2, fail
+        addi    s3, s3, 16
+        addi    s4, s4, 1
+        li      t0, NPAGES
+        bne     s4, t0, ring_record
+
+        li      t0, 1
+        j       finish
+fail:
+        li      t0, 3
+finish:
+        la      t1, tohost
+        sd      t0, 0(t1)
+park:
+        wfi
+        j       park
+
+        .data
+        .align  12
+pt_root: .zero  4096
+pt_l1:  .zero   4096
+pt_l0:  .zero   4096
+pages:  .zero   NPAGES * 4096
+frames: .zero   NPAGES * 4096
+
+        .align  3
+batch:  .zero   NPAGES * 8
+ring:   .zero   (4 + 2 * RING_SIZE) * 8
+
+        .align  6
+        .global tohost
+tohost: .dword  0
+        .align  6
+        .global fromhost
+fromhost: .dword 0
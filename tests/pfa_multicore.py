@@ -0,0 +1,20 @@
+#!/usr/bin/python
+
+import testlib
+import unittest
+
+class PfaMulticoreTest(unittest.TestCase):
+    def setUp(self):
+        self.binary = testlib.compile("pfa_multicore.s", "-nostdlib",
+                "-nostartfiles", "-Wl,-Ttext=0x80000000")
+
+    def test_p4(self):
+        """Make sure four harts can fault on remote pages at once, each
+        through its own free and new page queues."""
+        spike = testlib.Spike(self.binary, with_gdb=False, timeout=10,
+                args=["-p4"], pk=False)
+        result = spike.wait()
+        self.assertEqual(result, 0)
+
+if __name__ == '__main__':
+    unittest.main()
@@ -0,0 +1,226 @@
+# Four harts each take a PFA fault at the same time, each through its own
+# free and new page queues.  Hart 0 evicts one page per hart and builds an
+# Sv39 page table whose 4 KiB pages at VA 0x40000000 + hart * 4096 are remote.
+# Every hart then gives the PFA one free frame through its own port window,
+# drops to S-mode and loads from its page.  Back in M-mode it checks the data
+# and that its own new page queue holds exactly that page.
+#
+# Exits with 0 on success, 1 on failure.
+
+        .equ    PFA_BASE, 0x10017000
+        .equ    PFA_HART_STRIDE, 0x80
+        .equ    PFA_FREEFRAME, 0
+        .equ    PFA_FREESTAT, 8
+        .equ    PFA_EVICTPAGE, 16
+        .equ    PFA_EVICTSTAT, 24
+        .equ    PFA_NEWPGID, 32
+        .equ    PFA_NEWVADDR, 40
+        .equ    PFA_NEWSTAT, 48
+        .equ    PFA_EVICT_MAX, 256
+        .equ    PFA_FREE_MAX, 256
+
+        .equ    NHARTS, 4
+        .equ    REMOTE_VA, 0x40000000
+        .equ    FIRST_RPN, 100
+        .equ    PATTERN, 0x0101010101010101
+
+        .text
+        .global _start
+_start:
+        csrr    s0, mhartid
+        la      t0, trap
+        csrw    mtvec, t0
+        bnez    s0, wait_ready
+
+        # Fill page h with (h + 1) * PATTERN
+        la      t0, pages
+        li      t1, 0
+fill_page:
+        addi    t2, t1, 1
+        li      t3, PATTERN
+        mul     t2, t2, t3
+        li      t3, 512
+fill_word:
+        sd      t2, 0(t0)
+        addi    t0, t0, 8
+        addi    t3, t3, -1
+        bnez    t3, fill_word
+        addi    t1, t1, 1
+        li      t3, NHARTS
+        bne     t1, t3, fill_page
+
+        # Evict page h to remote ppn FIRST_RPN + h
+        li      s1, PFA_BASE
+        la      t0, pages
+        li      t1, 0
+evict:
+        addi    t2, t1, FIRST_RPN
+        slli    t2, t2, 36
+        srli    t3, t0, 12
+        or      t2, t2, t3
+        sd      t2, PFA_EVICTPAGE(s1)
+        li      t3, 4096
+        add     t0, t0, t3
+        addi    t1, t1, 1
+        li      t3, NHARTS
+        bne     t1, t3, evict
+
+        li      t1, PFA_EVICT_MAX
+evict_poll:
+        ld      t0, PFA_EVICTSTAT(s1)
+        bne     t0, t1, evict_poll
+
+        # Clear the frames so the data can only come from remote memory
+        la      t0, pages
+        li      t1, NHARTS * 512
+clear:
+        sd      zero, 0(t0)
+        addi    t0, t0, 8
+        addi    t1, t1, -1
+        bnez    t1, clear
+
+        # root[1] -> l1, l1[0] -> l0, root[2] maps 0x80000000 as a gigapage
+        la      t0, pt_root
+        la      t1, pt_l1
+        srli    t1, t1, 12
+        slli    t1, t1, 10
+        ori     t1, t1, 0x1
+        sd      t1, 8(t0)
+        li      t1, (0x80000000 >> 12) << 10 | 0xcf
+        sd      t1, 16(t0)
+        la      t0, pt_l1
+        la      t1, pt_l0
+        srli    t1, t1, 12
+        slli    t1, t1, 10
+        ori     t1, t1, 0x1
+        sd      t1, 0(t0)
+
+        # l0[h] is remote: page ID FIRST_RPN + h, protection V|R|W|A|D
+        la      t0, pt_l0
+        li      t1, 0
+remote_pte:
+        addi    t2, t1, FIRST_RPN
+        slli    t2, t2, 12
+        ori     t2, t2, (0xc7 << 2) | 0x2
+        sd      t2, 0(t0)
+        addi    t0, t0, 8
+        addi    t1, t1, 1
+        li      t3, NHARTS
+        bne     t1, t3, remote_pte
+
+        fence
+        li      t0, 1
+        la      t1, ready
+        sd      t0, 0(t1)
+
+wait_ready:
+        la      t1, ready
+        ld      t0, 0(t1)
+        beqz    t0, wait_ready
+        fence
+
+        # s1 = this hart's port window
+        li      s1, PFA_BASE
+        li      t0, PFA_HART_STRIDE
+        mul     t0, t0, s0
+        add     s1, s1, t0
+
+        li      t1, PFA_FREE_MAX
+        ld      t0, PFA_FREESTAT(s1)
+        bne     t0, t1, fail
+        la      t0, frames
+        slli    t1, s0, 12
+        add     t0, t0, t1
+        sd      t0, PFA_FREEFRAME(s1)
+
+        # Enter S-mode with the page table
+        la      t0, pt_root
+        srli    t0, t0, 12
+        li      t1, 8 << 60
+        or      t0, t0, t1
+        csrw    satp, t0
+        sfence.vma
+        li      t0, 0x1800
+        csrc    mstatus, t0
+        li      t0, 0x800
+        csrs    mstatus, t0
+        la      t0, s_entry
+        csrw    mepc, t0
+        mret
+
+s_entry:
+        li      s2, REMOTE_VA
+        slli    t0, s0, 12
+        add     s2, s2, t0
+        ld      a0, 0(s2)
+        li      t0, 4088
+        add     t0, s2, t0
+        ld      a1, 0(t0)
+        ecall
+
+        .align  2               # mtvec ignores the low two bits
+trap:
+        csrr    t0, mcause
+        li      t1, 9           # ecall from S-mode
+        bne     t0, t1, fail
+
+        addi    t0, s0, 1
+        li      t1, PATTERN
+        mul     t0, t0, t1
+        bne     a0, t0, fail
+        bne     a1, t0, fail
+
+        ld      t0, PFA_NEWSTAT(s1)
+        li      t1, 1
+        bne     t0, t1, fail
+        ld      t0, PFA_NEWVADDR(s1)
+        bne     t0, s2, fail
+        ld      t0, PFA_NEWPGID(s1)
+        addi    t1, s0, FIRST_RPN
+        bne     t0, t1, fail
+        j       finish
+
+fail:
+        li      t0, 1
+        la      t1, failed
+        amoor.d zero, t0, (t1)
+
+finish:
+        li      t0, 1
+        la      t1, done
+        amoadd.d zero, t0, (t1)
+        bnez    s0, park
+
+        li      t2, NHARTS
+wait_done:
+        ld      t0, 0(t1)
+        bne     t0, t2, wait_done
+
+        la      t1, failed
+        ld      t0, 0(t1)
+        slli    t0, t0, 1
+        ori     t0, t0, 1
+        la      t1, tohost
+        sd      t0, 0(t1)
+park:
+        wfi
+        j       park
+
+        .data
+        .align  12
+pt_root: .zero  4096
+pt_l1:  .zero   4096
+pt_l0:  .zero   4096
+pages:  .zero   NHARTS * 4096
+frames: .zero   NHARTS * 4096
+
+        .align  6
+        .global tohost
+tohost: .dword  0
+        .align  6
+        .global fromhost
+fromhost: .dword 0
+
+ready:  .dword  0
+done:   .dword  0
+failed: .dword  0
@@ -0,0 +1,20 @@
+#!/usr/bin/python
+
+import testlib
+import unittest
+
+class PfaPrefetchTest(unittest.TestCase):
+    def setUp(self):
+        self.binary = testlib.compile("pfa_prefetch.s", "-nostdlib",
+                "-nostartfiles", "-Wl,-Ttext=0x80000000")
+
+    def test_prefetch(self):
+        """Make sure a sequential scan over 16 remote pages with prefetch=3
+        faults only on every fourth page."""
+        spike = testlib.Spike(self.binary, with_gdb=False, timeout=10,
+                args=["--pfa=prefetch=3"], pk=False)
+        result = spike.wait()
+        self.assertEqual(result, 0)
+
+if __name__ == '__main__':
+    unittest.main()
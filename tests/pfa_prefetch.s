@@ -0,0 +1,199 @@
+# A sequential scan over 16 remote pages with the PFA prefetching 3 pages
+# after each fault (run with --pfa=prefetch=3).  The scan should fault on
+# every fourth page only, and the new page queue should report all 16
+# pages, 12 of them marked as prefetched.
+#
+# Exits with 0 on success, 1 on failure.
+
+        .equ    PFA_BASE, 0x10017000
+        .equ    PFA_FREEFRAME, 0
+        .equ    PFA_EVICTPAGE, 16
+        .equ    PFA_EVICTSTAT, 24
+        .equ    PFA_NEWPGID, 32
+        .equ    PFA_NEWVADDR, 40
+        .equ    PFA_NEWSTAT, 48
+        .equ    PFA_EVICT_MAX, 256
+
+        .equ    NPAGES, 16
+        .equ    NFAULTS, 4
+        .equ    REMOTE_VA, 0x40000000
+        .equ    FIRST_RPN, 100
+        .equ    PATTERN, 0x0101010101010101
+
+        .text
+        .global _start
+_start:
+        la      t0, trap
+        csrw    mtvec, t0
+        li      s1, PFA_BASE
+
+        # Fill page i with (i + 1) * PATTERN and evict it to FIRST_RPN + i
+        la      t0, pages
+        li      t1, 0
+fill_page:
+        addi    t2, t1, 1
+        li      t3, PATTERN
+        mul     t2, t2, t3
+        mv      t4, t0
+        li      t3, 512
+fill_word:
+        sd      t2, 0(t4)
+        addi    t4, t4, 8
+        addi    t3, t3, -1
+        bnez    t3, fill_word
+        addi    t2, t1, FIRST_RPN
+        slli    t2, t2, 36
+        srli    t3, t0, 12
+        or      t2, t2, t3
+        sd      t2, PFA_EVICTPAGE(s1)
+        li      t3, 4096
+        add     t0, t0, t3
+        addi    t1, t1, 1
+        li      t3, NPAGES
+        bne     t1, t3, fill_page
+
+        li      t1, PFA_EVICT_MAX
+evict_poll:
+        ld      t0, PFA_EVICTSTAT(s1)
+        bne     t0, t1, evict_poll
+
+        # Clear the frames so the data can only come from remote memory
+        la      t0, pages
+        li      t1, NPAGES * 512
+clear:
+        sd      zero, 0(t0)
+        addi    t0, t0, 8
+        addi    t1, t1, -1
+        bnez    t1, clear
+
+        # root[1] -> l1, l1[0] -> l0, root[2] maps 0x80000000 as a gigapage
+        la      t0, pt_root
+        la      t1, pt_l1
+        srli    t1, t1, 12
+        slli    t1, t1, 10
+        ori     t1, t1, 0x1
+        sd      t1, 8(t0)
+        li      t1, (0x80000000 >> 12) << 10 | 0xcf
+        sd      t1, 16(t0)
+        la      t0, pt_l1
+        la      t1, pt_l0
+        srli    t1, t1, 12
+        slli    t1, t1, 10
+        ori     t1, t1, 0x1
+        sd      t1, 0(t0)
+
+        # l0[i] is remote: page ID FIRST_RPN + i, protection V|R|W|A|D
+        la      t0, pt_l0
+        li      t1, 0
+remote_pte:
+        addi    t2, t1, FIRST_RPN
+        slli    t2, t2, 12
+        ori     t2, t2, (0xc7 << 2) | 0x2
+        sd      t2, 0(t0)
+        addi    t0, t0, 8
+        addi    t1, t1, 1
+        li      t3, NPAGES
+        bne     t1, t3, remote_pte
+
+        # One free frame per page
+        la      t0, frames
+        li      t1, NPAGES
+free:
+        sd      t0, PFA_FREEFRAME(s1)
+        li      t2, 4096
+        add     t0, t0, t2
+        addi    t1, t1, -1
+        bnez    t1, free
+
+        # Enter S-mode with the page table
+        la      t0, pt_root
+        srli    t0, t0, 12
+        li      t1, 8 << 60
+        or      t0, t0, t1
+        csrw    satp, t0
+        sfence.vma
+        li      t0, 0x1800
+        csrc    mstatus, t0
+        li      t0, 0x800
+        csrs    mstatus, t0
+        la      t0, s_entry
+        csrw    mepc, t0
+        mret
+
+        # Sum the first word of every page into a0
+s_entry:
+        li      s2, REMOTE_VA
+        li      t1, NPAGES
+        li      a0, 0
+scan:
+        ld      t0, 0(s2)
+        add     a0, a0, t0
+        li      t0, 4096
+        add     s2, s2, t0
+        addi    t1, t1, -1
+        bnez    t1, scan
+        ecall
+
+        .align  2               # mtvec ignores the low two bits
+trap:
+        csrr    t0, mcause
+        li      t1, 9           # ecall from S-mode
+        bne     t0, t1, fail
+
+        # 1 + 2 + ... + NPAGES times PATTERN
+        li      t0, NPAGES * (NPAGES + 1) / 2
+        li      t1, PATTERN
+        mul     t0, t0, t1
+        bne     a0, t0, fail
+
+        # Every page is reported, in address order, and all but the
+        # faulting ones are marked as prefetched
+        ld      t0, PFA_NEWSTAT(s1)
+        li      t1, NPAGES
+        bne     t0, t1, fail
+        li      s3, 0           # page
+        li      s4, 0           # prefetched pages
+new_page:
+        ld      t0, PFA_NEWPGID(s1)
+        ld      t1, PFA_NEWVADDR(s1)
+        srli    t2, t0, 63
+        add     s4, s4, t2
+        slli    t0, t0, 1
+        srli    t0, t0, 1
+        addi    t2, s3, FIRST_RPN
+        bne     t0, t2, fail
+        slli    t2, s3, 12
+        li      t3, REMOTE_VA
+        add     t2, t2, t3
+        bne     t1, t2, fail
+        addi    s3, s3, 1
+        li      t0, NPAGES
+        bne     s3, t0, new_page
+        li      t0, NPAGES - NFAULTS
+        bne     s4, t0, fail
+
+        li      t0, 1
+        j       finish
+fail:
+        li      t0, 3
+finish:
+        la      t1, tohost
+        sd      t0, 0(t1)
+park:
+        wfi
+        j       park
+
+        .data
+        .align  12
+pt_root: .zero  4096
+pt_l1:  .zero   4096
+pt_l0:  .zero   4096
+pages:  .zero   NPAGES * 4096
+frames: .zero   NPAGES * 4096
+
+        .align  6
+        .global tohost
+tohost: .dword  0
+        .align  6
+        .global fromhost
+fromhost: .dword 0
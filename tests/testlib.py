@@ -41,8 +41,10 @@ def unused_port():
     return port
 
 class Spike(object):
-    def __init__(self, binary, halted=False, with_gdb=True, timeout=None):
-        """Launch spike. Return tuple of its process and the port it's running on."""
+    def __init__(self, binary, halted=False, with_gdb=True, timeout=None,
+            args=(), pk=True):
+        """Launch spike. Return tuple of its process and the port it's running on.
+        args are extra spike options; pk=False runs binary without pk."""
         cmd = []
         if timeout:
             cmd += ["timeout", str(timeout)]
@@ -53,7 +55,9 @@ class Spike(object):
         if with_gdb:
             self.port = unused_port()
             cmd += ['--gdb-port', str(self.port)]
-        cmd.append('pk')
+        cmd += args
+        if pk:
+            cmd.append('pk')
         if binary:
             cmd.append(binary)
         logfile = open("spike.log", "w")